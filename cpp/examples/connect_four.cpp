@@ -11,6 +11,9 @@ const char PLAYER_1 = '1';
 const char PLAYER_2 = '2';
 const char EMPTY = '_';
 
+// Keys for each player's discs, then the player to move
+const Zobrist ZOBRIST(2 * WIDTH * HEIGHT + 2);
+
 struct ConnectFourMove : public Move<ConnectFourMove> {
     unsigned x;
 
@@ -40,6 +43,14 @@ struct ConnectFourMove : public Move<ConnectFourMove> {
         hash_combine(seed, hash_value(x));
         return seed;
     }
+
+    uint16_t pack() const {
+        return x;
+    }
+
+    static ConnectFourMove unpack(uint16_t packed) {
+        return ConnectFourMove(packed);
+    }
 };
 
 typedef pair<int, int> cords;
@@ -68,11 +79,6 @@ struct Board {
     }
 };
 
-size_t hash_value(const Board &board) {
-    std::hash<uint64_t> hash_fn;
-    return hash_fn(board.board);
-}
-
 struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
 
     Board board_1, board_2;
@@ -101,6 +107,7 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
                 }
             }
         }
+        zobrist = compute_zobrist();
     }
 
     ConnectFourState clone() const override {
@@ -108,6 +115,7 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
         clone.board_1 = Board(board_1);
         clone.board_2 = Board(board_2);
         clone.player_to_move = player_to_move;
+        clone.zobrist = zobrist;
         return clone;
     }
 
@@ -133,23 +141,20 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
     }
 
     vector<ConnectFourMove> get_legal_moves(int max_moves = INF) const override {
-        const auto &board = get_board(player_to_move);
-        int available_moves = WIDTH;
-        if (max_moves > available_moves) {
-            max_moves = available_moves;
-        }
-        vector<ConnectFourMove> moves(max_moves);
-        int i = 0;
+        MoveList<ConnectFourMove> moves;
+        get_legal_moves(moves, max_moves);
+        return vector<ConnectFourMove>(moves.begin(), moves.end());
+    }
+
+    void get_legal_moves(MoveList<ConnectFourMove> &moves, int max_moves = INF) const override {
         for (unsigned x = 0; x < WIDTH; ++x) {
             if (is_empty(x, 0)) {
-                moves[i++] = ConnectFourMove(x);
-                if (i >= max_moves) {
-                    return moves;
+                moves.push_back(ConnectFourMove(x));
+                if (moves.size() >= max_moves) {
+                    return;
                 }
             }
         }
-        moves.resize(i);
-        return moves;
     }
 
     bool is_terminal() const override {
@@ -176,6 +181,7 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
             if (is_empty(move.x, y)) {
                 auto &board = get_board(player_to_move);
                 board.set(move.x, y, 1);
+                zobrist ^= get_disc_key(player_to_move, move.x, y);
                 break;
             }
         }
@@ -185,6 +191,7 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
     void undo_move(const ConnectFourMove &move) override {
         for (int y = 0; y < HEIGHT; ++y) {
             if (!is_empty(move.x, y)) {
+                zobrist ^= get_disc_key(board_1.get(move.x, y) ? 0 : 1, move.x, y);
                 board_1.set(move.x, y, 0);
                 board_2.set(move.x, y, 0);
                 break;
@@ -193,6 +200,14 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
         player_to_move = get_next_player(player_to_move);
     }
 
+    uint64_t get_disc_key(int player, int x, int y) const {
+        return ZOBRIST[player * WIDTH * HEIGHT + y * WIDTH + x];
+    }
+
+    uint64_t get_player_to_move_key(int player) const {
+        return ZOBRIST[2 * WIDTH * HEIGHT + player];
+    }
+
     bool has_empty_space() const {
         uint64_t board = board_1.board | board_2.board;
         // checks if top row has any empty space
@@ -228,12 +243,24 @@ struct ConnectFourState : public State<ConnectFourState, ConnectFourMove> {
     }
 
     size_t hash() const override {
-        using boost::hash_value;
-        using boost::hash_combine;
-        size_t seed = 0;
-        hash_combine(seed, hash_value(board_1));
-        hash_combine(seed, hash_value(board_2));
-        hash_combine(seed, hash_value(player_to_move));
-        return seed;
+        return zobrist ^ get_player_to_move_key(player_to_move);
+    }
+
+    uint64_t compute_zobrist() const override {
+        uint64_t result = 0;
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                if (board_1.get(x, y)) {
+                    result ^= get_disc_key(0, x, y);
+                } else if (board_2.get(x, y)) {
+                    result ^= get_disc_key(1, x, y);
+                }
+            }
+        }
+        return result;
+    }
+
+    string get_variant() const override {
+        return "connect_four width: " + to_string(WIDTH) + " height: " + to_string(HEIGHT);
     }
 };
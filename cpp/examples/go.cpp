@@ -7,6 +7,9 @@ const char PLAYER_1 = '1';
 const char PLAYER_2 = '2';
 const char EMPTY = '_';
 
+// Keys for each player's stones
+const Zobrist ZOBRIST(2 * SIDE * SIDE);
+
 struct GoMove : public Move<GoMove> {
     int x;
     int y;
@@ -38,6 +41,15 @@ struct GoMove : public Move<GoMove> {
         hash_combine(seed, hash_value(y));
         return seed;
     }
+
+    // x is shifted by one, so that the pass (x = -1) packs too
+    uint16_t pack() const {
+        return (x + 1) | y << 8;
+    }
+
+    static GoMove unpack(uint16_t packed) {
+        return GoMove((packed & 255) - 1, packed >> 8);
+    }
 };
 
 struct cords {
@@ -67,6 +79,7 @@ struct GoState : public State<GoState, GoMove> {
 
     vector<char> board;
     vector<char> prev_board;
+    uint64_t prev_zobrist = 0;
     unordered_set<size_t> board_history;
     vector<bool> pass;
 
@@ -88,6 +101,7 @@ struct GoState : public State<GoState, GoMove> {
         }
         board = vector<char>(init_string.begin(), init_string.end());
         pass = vector<bool>(teams.size());
+        zobrist = compute_zobrist();
         board_history.insert(hash());
     }
 
@@ -98,6 +112,8 @@ struct GoState : public State<GoState, GoMove> {
         clone.pass = pass;
         clone.board_history = board_history;
         clone.player_to_move = player_to_move;
+        clone.zobrist = zobrist;
+        clone.prev_zobrist = prev_zobrist;
         return clone;
     }
 
@@ -115,14 +131,14 @@ struct GoState : public State<GoState, GoMove> {
     }
 
     vector<GoMove> get_legal_moves(int max_moves = INF) const override {
+        MoveList<GoMove> moves;
+        get_legal_moves(moves, max_moves);
+        return vector<GoMove>(moves.begin(), moves.end());
+    }
+
+    void get_legal_moves(MoveList<GoMove> &moves, int max_moves = INF) const override {
         // A turn is either a pass; or a move that doesn't repeat an earlier grid coloring.
-        int available_moves = SIDE * SIDE + 1;
-        if (max_moves > available_moves) {
-            max_moves = available_moves;
-        }
-        vector<GoMove> moves(max_moves);
         auto copy = clone();
-        int i = 0;
         for (int y = 0; y < SIDE; ++y) {
             for (int x = 0; x < SIDE; ++x) {
                 if (board[y * SIDE + x] == EMPTY) {
@@ -131,17 +147,15 @@ struct GoState : public State<GoState, GoMove> {
                     auto hash = copy.hash();
                     copy.undo_move(move);
                     if (board_history.find(hash) == board_history.end()) { // positional superko
-                        moves[i++] = move;
-                        if (i >= max_moves) {
-                            return moves;
+                        moves.push_back(move);
+                        if (moves.size() >= max_moves) {
+                            return;
                         }
                     }
                 }
             }
         }
-        moves[i++] = GoMove(-1, 0); // pass
-        moves.resize(i);
-        return moves;
+        moves.push_back(GoMove(-1, 0)); // pass
     }
 
     bool is_terminal() const override {
@@ -210,6 +224,7 @@ struct GoState : public State<GoState, GoMove> {
         if (result.closed) {
             for (const cords c : result.area) {
                 board[c.y * SIDE + c.x] = EMPTY;
+                zobrist ^= get_stone_key(player, c.x, c.y);
             }
         }
     }
@@ -222,7 +237,9 @@ struct GoState : public State<GoState, GoMove> {
         }
         pass[player_to_move] = false;
         prev_board = board;
+        prev_zobrist = zobrist;
         board[move.y * SIDE + move.x] = player_index_to_char(player_to_move);
+        zobrist ^= get_stone_key(player_to_move, move.x, move.y);
         const int enemy = get_next_player(player_to_move);
         clear(move.x, move.y - 1, enemy);
         clear(move.x + 1, move.y, enemy);
@@ -237,9 +254,14 @@ struct GoState : public State<GoState, GoMove> {
         board_history.erase(hash());
         player_to_move = get_prev_player(player_to_move);
         board = prev_board;
+        zobrist = prev_zobrist;
         pass[player_to_move] = false;
     }
 
+    uint64_t get_stone_key(int player, int x, int y) const {
+        return ZOBRIST[player * SIDE * SIDE + y * SIDE + x];
+    }
+
     int player_char_to_index(char player) const override {
         return (player == PLAYER_1) ? 0 : 1;
     }
@@ -268,10 +290,23 @@ struct GoState : public State<GoState, GoMove> {
     }
 
     size_t hash() const override {
-        using boost::hash_value;
-        using boost::hash_combine;
-        size_t seed = 0;
-        hash_combine(seed, hash_value(board));
-        return seed;
+        return zobrist;
+    }
+
+    uint64_t compute_zobrist() const override {
+        uint64_t result = 0;
+        for (int y = 0; y < SIDE; ++y) {
+            for (int x = 0; x < SIDE; ++x) {
+                const char c = board[y * SIDE + x];
+                if (c != EMPTY) {
+                    result ^= get_stone_key(player_char_to_index(c), x, y);
+                }
+            }
+        }
+        return result;
+    }
+
+    string get_variant() const override {
+        return "go side: " + to_string(SIDE);
     }
 };
@@ -16,6 +16,17 @@ const char REMOVED = '#';
 const string EMPTY_EXEC = "0";
 const string REMOVED_EXEC = "-1";
 
+const int MAX_PLAYERS = 9;
+// Separated regions up to this many squares are solved exactly, larger ones are left to the search
+const int MAX_SOLVED_REGION = 10;
+const int SURVIVAL_CACHE_SIZE = 1 << 15;
+const uint64_t FULL_MASK = (1ULL << SIDE * SIDE) - 1;
+// Board bits, without the last and the first column, to shift sideways without wrapping
+const uint64_t NOT_LAST_COLUMN = FULL_MASK & ~(0x0040810204081ULL << (SIDE - 1));
+const uint64_t NOT_FIRST_COLUMN = FULL_MASK & ~0x0040810204081ULL;
+// Keys for: removed squares, then each player's square, then the player to move
+const Zobrist ZOBRIST(SIDE * SIDE + MAX_PLAYERS * SIDE * SIDE + MAX_PLAYERS);
+
 struct IsolaMove : public Move<IsolaMove> {
     unsigned from_x;
     unsigned from_y;
@@ -64,6 +75,19 @@ struct IsolaMove : public Move<IsolaMove> {
         hash_combine(seed, hash_value(remove_y));
         return seed;
     }
+
+    // 4 bits per coordinate
+    uint32_t pack() const {
+        return from_x | from_y << 4 | step_x << 8 | step_y << 12 | remove_x << 16 | remove_y << 20;
+    }
+
+    static IsolaMove unpack(uint32_t packed) {
+        return IsolaMove(
+                packed & 15, packed >> 4 & 15,
+                packed >> 8 & 15, packed >> 12 & 15,
+                packed >> 16 & 15, packed >> 20 & 15
+        );
+    }
 };
 
 typedef pair<int, int> cords;
@@ -90,15 +114,12 @@ struct Board {
     }
 };
 
-size_t hash_value(const Board &board) {
-    std::hash<bitset<SIDE * SIDE>> hash_fn;
-    return hash_fn(board.board);
-}
-
 struct IsolaState : public State<IsolaState, IsolaMove> {
 
     Board board;
     vector<cords> player_cords;
+    // Adds 0-2 at random to get_goodness, so that games between the same bots differ
+    bool noise = true;
 
     IsolaState(const vector<int> &teams) : State(teams) {}
 
@@ -108,8 +129,8 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
         if (length != correct_length) {
             throw invalid_argument("Initialization string length must be " + to_string(correct_length));
         }
-        if (teams.size() > 9) {
-            throw invalid_argument("Maximum number of players is 9");
+        if (teams.size() > MAX_PLAYERS) {
+            throw invalid_argument("Maximum number of players is " + to_string(MAX_PLAYERS));
         }
         player_cords = vector<cords>(teams.size(), {-1, -1});
         for (int i = 0; i < length; i++) {
@@ -135,10 +156,12 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
                 throw invalid_argument("Missing player symbols");
             }
         }
+        zobrist = compute_zobrist();
     }
 
     void swap_players() override {
         std::shuffle(player_cords.begin(), player_cords.end(), std::mt19937());
+        zobrist = compute_zobrist();
     }
 
     IsolaState clone() const override {
@@ -146,6 +169,8 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
         clone.board = Board(board);
         clone.player_cords = player_cords;
         clone.player_to_move = player_to_move;
+        clone.zobrist = zobrist;
+        clone.noise = noise;
         return clone;
     }
 
@@ -163,7 +188,7 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
 
     int get_goodness() const override {
         cords our_cords = get_player_cords(player_to_move);
-        cords enemy_cords = get_player_cords(get_next_player(player_to_move));
+        cords enemy_cords = get_player_cords(get_next_enemy(player_to_move));
 
         int player_moves = count_moves_around(our_cords);
         if (player_moves == 0) {
@@ -181,55 +206,103 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
 
         int mobility = mobility_score(player_moves) - mobility_score(enemy_moves);
         int center = center_score(our_cords) - center_score(enemy_cords);
-        int noise = random() % 3;
+        const int random_score = noise ? random() % 3 : 0;
 
-        return 5 * mobility + center - 3 * moves_to_enemy + noise;
+        return 5 * mobility + center - 3 * moves_to_enemy + random_score;
     }
 
     vector<IsolaMove> get_legal_moves(int how_many = INF) const override {
+        MoveList<IsolaMove> moves;
+        get_legal_moves(moves, how_many);
+        return vector<IsolaMove>(moves.begin(), moves.end());
+    }
+
+    void get_legal_moves(MoveList<IsolaMove> &moves, int how_many = INF) const override {
         auto our_cords = get_player_cords(player_to_move);
-        auto step_moves = get_moves_around(our_cords.first, our_cords.second);
+        MoveList<cords, 8> step_moves;
+        get_moves_around(step_moves, our_cords.first, our_cords.second);
         assert(!step_moves.empty());
 
         int how_many_removes = ceil((double) how_many / step_moves.size());
-        auto remove_moves = get_remove_moves(how_many_removes);
+        MoveList<cords, SIDE * SIDE> remove_moves;
+        get_remove_moves(remove_moves, how_many_removes);
 
-        int moves_count = step_moves.size() * remove_moves.size();
-        if (how_many > moves_count) {
-            how_many = moves_count;
+        for (const auto &step_move : step_moves) {
+            for (const auto &remove_move : remove_moves) {
+                if (step_move == remove_move) {
+                    continue;
+                }
+                moves.push_back(IsolaMove(
+                        our_cords.first, our_cords.second,
+                        step_move.first, step_move.second,
+                        remove_move.first, remove_move.second
+                ));
+                if (moves.size() >= how_many) {
+                    return;
+                }
+            }
         }
-        vector<IsolaMove> moves(how_many);
+    }
 
-        int size = 0;
-        for (auto step_move : step_moves) {
-            for (auto remove_move : remove_moves) {
+    // Noisy when a player is about to be trapped: either we have one square left to step on,
+    // or the enemy has at most two, so removing one of them may leave it without an escape.
+    bool get_noisy_moves(MoveList<IsolaMove> &moves) const override {
+        const auto our_cords = get_player_cords(player_to_move);
+        const auto enemy_cords = get_player_cords(get_next_enemy(player_to_move));
+        MoveList<cords, 8> step_moves;
+        get_moves_around(step_moves, our_cords.first, our_cords.second);
+        MoveList<cords, 8> enemy_moves;
+        get_moves_around(enemy_moves, enemy_cords.first, enemy_cords.second);
+        const bool forced = step_moves.size() <= 1;
+        if (!forced && enemy_moves.size() > 2) {
+            return true;
+        }
+        for (const auto &step_move : step_moves) {
+            for (const auto &remove_move : enemy_moves) {
                 if (step_move == remove_move) {
                     continue;
                 }
-                moves[size++] = IsolaMove(
+                moves.push_back(IsolaMove(
                         our_cords.first, our_cords.second,
                         step_move.first, step_move.second,
                         remove_move.first, remove_move.second
-                );
-                if (size >= how_many) {
-                    return moves;
-                }
+                ));
             }
         }
+        if (forced && moves.empty()) {
+            // Nothing to remove near the enemy, still our only step has to be searched
+            get_legal_moves(moves, 1);
+        }
+        return !forced;
+    }
 
-        moves.resize(size);
-        return moves;
+    // Removing a square is never worse than not removing it, so a pass is safe
+    // unless stepping away matters, which it does when we are nearly trapped.
+    bool can_pass() const override {
+        return count_moves_around(get_player_cords(player_to_move)) > 2;
+    }
+
+    void make_pass() override {
+        player_to_move = get_next_player(player_to_move);
+    }
+
+    void undo_pass() override {
+        player_to_move = get_prev_player(player_to_move);
     }
 
     vector<cords> get_remove_moves(int how_many = INF) const {
+        MoveList<cords, SIDE * SIDE> result;
+        get_remove_moves(result, how_many);
+        return vector<cords>(result.begin(), result.end());
+    }
+
+    void get_remove_moves(MoveList<cords, SIDE * SIDE> &result, int how_many = INF) const {
         int moves_count = SIDE * SIDE;
         if (how_many > moves_count) {
             how_many = moves_count;
         }
-        vector<cords> result(how_many);
 
-        int size = 0;
-        auto enemy = get_next_player(player_to_move);
+        auto enemy = get_next_enemy(player_to_move);
         auto enemy_cords = get_player_cords(enemy);
 
         for (int d = 1; d < SIDE; ++d) {
@@ -237,19 +310,19 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
                 int x = enemy_cords.first + dx;
                 int y = enemy_cords.second - d;
                 if (x >= 0 && x < SIDE && y >= 0 && y < SIDE && is_empty(x, y)) {
-                    result[size++] = make_pair(x, y);
-                    if (size >= how_many - 1) {
-                        result[size++] = get_player_cords(player_to_move);
-                        return result;
+                    result.push_back(make_pair(x, y));
+                    if (result.size() >= how_many - 1) {
+                        result.push_back(get_player_cords(player_to_move));
+                        return;
                     }
                 }
                 x = enemy_cords.first - dx;
                 y = enemy_cords.second + d;
                 if (x >= 0 && x < SIDE && y >= 0 && y < SIDE && is_empty(x, y)) {
-                    result[size++] = make_pair(x, y);
-                    if (size >= how_many - 1) {
-                        result[size++] = get_player_cords(player_to_move);
-                        return result;
+                    result.push_back(make_pair(x, y));
+                    if (result.size() >= how_many - 1) {
+                        result.push_back(get_player_cords(player_to_move));
+                        return;
                     }
                 }
             }
@@ -257,27 +330,25 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
                 int x = enemy_cords.first + d;
                 int y = enemy_cords.second + dy;
                 if (x >= 0 && x < SIDE && y >= 0 && y < SIDE && is_empty(x, y)) {
-                    result[size++] = make_pair(x, y);
-                    if (size >= how_many - 1) {
-                        result[size++] = get_player_cords(player_to_move);
-                        return result;
+                    result.push_back(make_pair(x, y));
+                    if (result.size() >= how_many - 1) {
+                        result.push_back(get_player_cords(player_to_move));
+                        return;
                     }
                 }
                 x = enemy_cords.first - d;
                 y = enemy_cords.second - dy;
                 if (x >= 0 && x < SIDE && y >= 0 && y < SIDE && is_empty(x, y)) {
-                    result[size++] = make_pair(x, y);
-                    if (size >= how_many - 1) {
-                        result[size++] = get_player_cords(player_to_move);
-                        return result;
+                    result.push_back(make_pair(x, y));
+                    if (result.size() >= how_many - 1) {
+                        result.push_back(get_player_cords(player_to_move));
+                        return;
                     }
                 }
             }
         }
 
-        result[size++] = get_player_cords(player_to_move);
-        result.resize(size);
-        return result;
+        result.push_back(get_player_cords(player_to_move));
     }
 
     bool is_terminal() const override {
@@ -298,9 +369,121 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
         return !is_team_mate(player) && is_terminal();
     }
 
+    // Once the pawns can't reach each other, a region loses squares only to the enemy's removals,
+    // removing our own is never better. So each region is a game of its own: the pawn steps,
+    // then the enemy removes a square, and the one that survives more turns wins.
+    bool get_solved_goodness(int &goodness) const override {
+        if (teams.size() != 2) {
+            return false;
+        }
+        const int enemy = get_next_player(player_to_move);
+        const int our_index = get_index(get_player_cords(player_to_move));
+        const int enemy_index = get_index(get_player_cords(enemy));
+        const uint64_t empty = get_empty_mask();
+        // A pawn's square empties when it steps, so each region with its pawn has to be apart from the other one:
+        // ours can't reach a square next to the enemy pawn, and our pawn can't stand next to the enemy region
+        const uint64_t our_square = 1ULL << our_index;
+        const uint64_t enemy_near = get_neighbors(1ULL << enemy_index);
+        if ((enemy_near & our_square) != 0) {
+            return false;
+        }
+        const uint64_t our_region = get_region(empty, our_index, enemy_near);
+        if ((our_region & enemy_near) != 0 || __builtin_popcountll(our_region) > MAX_SOLVED_REGION) {
+            return false;
+        }
+        const uint64_t enemy_region = get_region(empty, enemy_index);
+        if ((get_neighbors(our_square) & enemy_region) != 0 || __builtin_popcountll(enemy_region) > MAX_SOLVED_REGION) {
+            return false;
+        }
+        // we step first, the enemy region loses a square before its first step,
+        // we win if any removal leaves the enemy fewer turns than we have
+        const int our_survival = get_survival(our_region, our_index, __builtin_popcountll(enemy_region) + 1);
+        bool winning = enemy_region == 0;
+        const uint64_t near = enemy_near & enemy_region;
+        for (const uint64_t removes : {near, enemy_region & ~near}) {
+            for (uint64_t rest = removes; rest != 0 && !winning; rest &= rest - 1) {
+                const uint64_t region = get_region(enemy_region & ~(rest & -rest), enemy_index);
+                winning = get_survival(region, enemy_index, our_survival) < our_survival;
+            }
+        }
+        goodness = winning ? 10000 : -10000;
+        return true;
+    }
+
+    // How many more turns, up to cap, the pawn at index steps within region (the empty squares it reaches),
+    // when the enemy removes one of them after each step
+    static int get_survival(uint64_t region, int index, int cap) {
+        static thread_local uint64_t cache[SURVIVAL_CACHE_SIZE];
+        // the region takes 49 bits, the index 6, then a bit whether the value is exact or a lower bound,
+        // the value takes the top byte, so 0 is an empty slot
+        const uint64_t key = region | (uint64_t) index << (SIDE * SIDE);
+        const uint64_t EXACT = 1ULL << 55;
+        uint64_t &slot = cache[(key * 0x9e3779b97f4a7c15ULL) >> 49 & (SURVIVAL_CACHE_SIZE - 1)];
+        if ((slot & (EXACT - 1)) == key && slot != 0) {
+            const int value = (slot >> 56) - 1;
+            if ((slot & EXACT) || value >= cap) {
+                return std::min(value, cap);
+            }
+        }
+        // every turn the region loses a square, so the pawn can't outlast it
+        cap = std::min(cap, __builtin_popcountll(region));
+        int best = 0;
+        for (uint64_t steps = get_neighbors(1ULL << index) & region; steps != 0 && best < cap; steps &= steps - 1) {
+            const uint64_t step = steps & -steps;
+            const int step_index = __builtin_ctzll(step);
+            // the square left behind stays empty
+            const uint64_t after = (region & ~step) | 1ULL << index;
+            // removing next to the pawn is usually the worst for it, try that first to cut sooner
+            const uint64_t near = get_neighbors(step) & after;
+            int worst = cap - 1;
+            for (const uint64_t removes : {near, after & ~near}) {
+                for (uint64_t rest = removes; rest != 0 && 1 + worst > best; rest &= rest - 1) {
+                    const uint64_t region = get_region(after & ~(rest & -rest), step_index);
+                    worst = std::min(worst, get_survival(region, step_index, cap - 1));
+                }
+            }
+            best = std::max(best, 1 + worst);
+        }
+        // reaching the cap only bounds the value from below
+        slot = key | (best < cap || cap == __builtin_popcountll(region) ? EXACT : 0) | (uint64_t) (best + 1) << 56;
+        return best;
+    }
+
+    // Empty squares reachable from the given one, without it. Stops early once it reaches one of stop.
+    static uint64_t get_region(uint64_t empty, int index, uint64_t stop = 0) {
+        uint64_t region = 1ULL << index;
+        while (true) {
+            const uint64_t grown = region | (get_neighbors(region) & empty);
+            if (grown == region || (grown & stop) != 0) {
+                return grown & ~(1ULL << index);
+            }
+            region = grown;
+        }
+    }
+
+    static uint64_t get_neighbors(uint64_t squares) {
+        const uint64_t row = squares | (squares & NOT_LAST_COLUMN) << 1 | (squares & NOT_FIRST_COLUMN) >> 1;
+        return (row | row << SIDE | row >> SIDE) & FULL_MASK & ~squares;
+    }
+
+    uint64_t get_empty_mask() const {
+        uint64_t empty = ~board.board.to_ullong() & FULL_MASK;
+        for (const auto &c : player_cords) {
+            empty &= ~(1ULL << get_index(c));
+        }
+        return empty;
+    }
+
+    static int get_index(const cords &c) {
+        return c.second * SIDE + c.first;
+    }
+
     void make_move(const IsolaMove &move) override {
         board.set(move.remove_x, move.remove_y, 1);
         set_player_cords(player_to_move, make_pair(move.step_x, move.step_y));
+        zobrist ^= get_removed_key(move.remove_x, move.remove_y)
+                   ^ get_player_key(player_to_move, move.from_x, move.from_y)
+                   ^ get_player_key(player_to_move, move.step_x, move.step_y);
         player_to_move = get_next_player(player_to_move);
     }
 
@@ -308,11 +491,25 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
         player_to_move = get_prev_player(player_to_move);
         set_player_cords(player_to_move, make_pair(move.from_x, move.from_y));
         board.set(move.remove_x, move.remove_y, 0);
+        zobrist ^= get_removed_key(move.remove_x, move.remove_y)
+                   ^ get_player_key(player_to_move, move.from_x, move.from_y)
+                   ^ get_player_key(player_to_move, move.step_x, move.step_y);
+    }
+
+    uint64_t get_removed_key(int x, int y) const {
+        return ZOBRIST[y * SIDE + x];
     }
 
-    vector<cords> get_moves_around(int start_x, int start_y) const {
+    uint64_t get_player_key(int player, int x, int y) const {
+        return ZOBRIST[SIDE * SIDE * (1 + player) + y * SIDE + x];
+    }
+
+    uint64_t get_player_to_move_key(int player) const {
+        return ZOBRIST[SIDE * SIDE * (1 + MAX_PLAYERS) + player];
+    }
+
+    void get_moves_around(MoveList<cords, 8> &result, int start_x, int start_y) const {
         // Closer to the center first
-        vector<cords> result(8);
         int dx_order = 1;
         if (start_x < SIDE / 2) {
             dx_order = -1;
@@ -321,18 +518,15 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
         if (start_y < SIDE / 2) {
             dy_order = -1;
         }
-        unsigned moves_count = 0;
         for (int dy = -1; dy <= 1; ++dy) {
             for (int dx = -1; dx <= 1; ++dx) {
                 const int x = start_x + dx * dx_order;
                 const int y = start_y + dy * dy_order;
                 if (x >= 0 && x < SIDE && y >= 0 && y < SIDE && is_empty(x, y)) {
-                    result[moves_count++] = make_pair(x, y);
+                    result.push_back(make_pair(x, y));
                 }
             }
         }
-        result.resize(moves_count);
-        return result;
     }
 
     int count_moves_around(const cords &c) const {
@@ -418,12 +612,31 @@ struct IsolaState : public State<IsolaState, IsolaMove> {
     }
 
     size_t hash() const override {
-        using boost::hash_value;
-        using boost::hash_combine;
-        size_t seed = 0;
-        hash_combine(seed, hash_value(board));
-        hash_combine(seed, hash_value(player_cords));
-        hash_combine(seed, hash_value(player_to_move));
-        return seed;
+        // player_to_move is mixed in here, so it can be assigned directly
+        return zobrist ^ get_player_to_move_key(player_to_move);
+    }
+
+    uint64_t compute_zobrist() const override {
+        uint64_t result = 0;
+        for (int y = 0; y < SIDE; ++y) {
+            for (int x = 0; x < SIDE; ++x) {
+                if (board.get(x, y)) {
+                    result ^= get_removed_key(x, y);
+                }
+            }
+        }
+        for (int i = 0; i < player_cords.size(); ++i) {
+            result ^= get_player_key(i, player_cords[i].first, player_cords[i].second);
+        }
+        return result;
+    }
+
+    string get_variant() const override {
+        stringstream ss;
+        ss << "isola side: " << SIDE << " teams:";
+        for (const auto team : teams) {
+            ss << " " << team;
+        }
+        return ss.str();
     }
 };
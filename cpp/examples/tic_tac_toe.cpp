@@ -1,10 +1,17 @@
+#include <array>
+
 #include "../gtsa.hpp"
 
+using std::array;
+
 const int SIDE = 3;
 const char PLAYER_1 = 'X';
 const char PLAYER_2 = 'O';
 const char EMPTY = '_';
 
+// Keys for each player's marks
+const Zobrist ZOBRIST(2 * SIDE * SIDE);
+
 struct TicTacToeMove : public Move<TicTacToeMove> {
     unsigned x;
     unsigned y;
@@ -36,6 +43,14 @@ struct TicTacToeMove : public Move<TicTacToeMove> {
         hash_combine(seed, hash_value(y));
         return seed;
     }
+
+    uint16_t pack() const {
+        return x | y << 8;
+    }
+
+    static TicTacToeMove unpack(uint16_t packed) {
+        return TicTacToeMove(packed & 255, packed >> 8);
+    }
 };
 
 const vector<vector<TicTacToeMove>> LINES = [] {
@@ -82,12 +97,14 @@ struct TicTacToeState : public State<TicTacToeState, TicTacToeMove> {
             }
         }
         board = vector<char>(init_string.begin(), init_string.end());
+        zobrist = compute_zobrist();
     }
 
     TicTacToeState clone() const override {
         TicTacToeState clone = TicTacToeState();
         clone.board = board;
         clone.player_to_move = player_to_move;
+        clone.zobrist = zobrist;
         return clone;
     }
 
@@ -120,24 +137,22 @@ struct TicTacToeState : public State<TicTacToeState, TicTacToeMove> {
     }
 
     vector<TicTacToeMove> get_legal_moves(int max_moves = INF) const override {
-        int available_moves = SIDE * SIDE;
-        if (max_moves > available_moves) {
-            max_moves = available_moves;
-        }
-        vector<TicTacToeMove> moves(max_moves);
-        int i = 0;
+        MoveList<TicTacToeMove> moves;
+        get_legal_moves(moves, max_moves);
+        return vector<TicTacToeMove>(moves.begin(), moves.end());
+    }
+
+    void get_legal_moves(MoveList<TicTacToeMove> &moves, int max_moves = INF) const override {
         for (int y = 0; y < SIDE; ++y) {
             for (int x = 0; x < SIDE; ++x) {
                 if (board[y * SIDE + x] == EMPTY) {
-                    moves[i++] = TicTacToeMove(x, y);
-                    if (i >= max_moves) {
-                        return moves;
+                    moves.push_back(TicTacToeMove(x, y));
+                    if (moves.size() >= max_moves) {
+                        return;
                     }
                 }
             }
         }
-        moves.resize(i);
-        return moves;
     }
 
     bool is_terminal() const override {
@@ -173,14 +188,21 @@ struct TicTacToeState : public State<TicTacToeState, TicTacToeMove> {
 
     void make_move(const TicTacToeMove &move) override {
         board[move.y * SIDE + move.x] = player_index_to_char(player_to_move);
+        zobrist ^= get_mark_key(player_to_move, move.x, move.y);
         player_to_move = get_next_player(player_to_move);
     }
 
     void undo_move(const TicTacToeMove &move) override {
+        const int player = player_char_to_index(board[move.y * SIDE + move.x]);
+        zobrist ^= get_mark_key(player, move.x, move.y);
         board[move.y * SIDE + move.x] = EMPTY;
         player_to_move = get_next_player(player_to_move);
     }
 
+    uint64_t get_mark_key(int player, int x, int y) const {
+        return ZOBRIST[player * SIDE * SIDE + y * SIDE + x];
+    }
+
     bool has_empty_space() const {
         for (unsigned y = 0; y < SIDE; ++y) {
             for (unsigned x = 0; x < SIDE; ++x) {
@@ -192,8 +214,8 @@ struct TicTacToeState : public State<TicTacToeState, TicTacToeMove> {
         return false;
     }
 
-    vector<int> count_players_on_lines(int player) const {
-        vector<int> counts(2 * LINES_SIZE);
+    array<int, 2 * LINES_SIZE> count_players_on_lines(int player) const {
+        array<int, 2 * LINES_SIZE> counts;
         const auto enemy = player_index_to_char(get_next_player(player));
         for (int i = 0; i < LINES_SIZE; ++i) {
             int player_places = 0;
@@ -230,10 +252,23 @@ struct TicTacToeState : public State<TicTacToeState, TicTacToeMove> {
     }
 
     size_t hash() const override {
-        using boost::hash_value;
-        using boost::hash_combine;
-        size_t seed = 0;
-        hash_combine(seed, hash_value(board));
-        return seed;
+        return zobrist;
+    }
+
+    uint64_t compute_zobrist() const override {
+        uint64_t result = 0;
+        for (int y = 0; y < SIDE; ++y) {
+            for (int x = 0; x < SIDE; ++x) {
+                const char c = board[y * SIDE + x];
+                if (c != EMPTY) {
+                    result ^= get_mark_key(player_char_to_index(c), x, y);
+                }
+            }
+        }
+        return result;
+    }
+
+    string get_variant() const override {
+        return "tic_tac_toe side: " + to_string(SIDE);
     }
 };
@@ -23,6 +23,14 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <unordered_map>
 #include <unordered_set>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstdint>
+#include <cstring>
+#include <typeinfo>
 #include <algorithm>
 #include <iostream>
 #include <cassert>
@@ -31,7 +39,11 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <iomanip>
 #include <memory>
 #include <random>
+#include <thread>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
 
 using std::cin;
 using std::cout;
@@ -45,6 +57,7 @@ using std::function;
 using std::to_string;
 using std::shared_ptr;
 using std::make_shared;
+using std::unique_ptr;
 using std::stringstream;
 using std::runtime_error;
 using std::unordered_map;
@@ -52,14 +65,26 @@ using std::unordered_set;
 using std::invalid_argument;
 
 static const int MAX_SIMULATIONS = 10000000;
+static const int VIRTUAL_VISITS = 5;
 static const double UCT_C = sqrt(2);
 static const double WIN_SCORE = 1;
 static const double DRAW_SCORE = 0.5;
 static const double LOSE_SCORE = 0;
 
 static const int MAX_DEPTH = 20;
+static const int MAX_PLY = 64;
+static const int KILLERS = 2;
+static const int HISTORY_SIZE = 1 << 12;
+static const int MAX_LEGAL_MOVES = 512;
+// Moves picked one by one by history score before the rest is sorted
+static const int LAZY_PICKS = 3;
+static const int QUIESCENCE_DEPTH = 4;
 static const int INF = 2147483647;
 static const int SEED = 42;
+static const double CLOCK_TOLERANCE = 0.001;
+static const double MAX_EBF = 100;
+static const int TT_MEGABYTES = 16;
+static const int CACHE_LINE = 64;
 
 struct Random {
     std::mt19937 engine = std::mt19937(SEED);
@@ -72,6 +97,32 @@ struct Random {
     }
 };
 
+// Random keys for Zobrist hashing, the same in every run
+struct Zobrist {
+    vector<uint64_t> keys;
+
+    Zobrist(size_t size) : keys(size) {
+        std::mt19937_64 engine(SEED);
+        for (auto &key : keys) {
+            key = engine();
+        }
+    }
+
+    uint64_t operator[](size_t index) const {
+        return keys[index];
+    }
+};
+
+// FNV-1a, stable across runs and platforms, unlike std::hash, so it can be written to files
+static uint64_t get_fnv_hash(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t result = seed;
+    for (size_t i = 0; i < size; ++i) {
+        result = (result ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return result;
+}
+
 struct Timer {
     double start_time;
 
@@ -100,6 +151,233 @@ struct Timer {
     }
 };
 
+// Monotonic clock for the search loops, which ask whether the time is up once per node or simulation.
+// exceeded() reads the clock only every interval calls. The interval is calibrated from the measured
+// calls per second, so that the deadline is missed by less than the tolerance.
+struct SearchClock {
+    typedef std::chrono::steady_clock clock;
+    static const int MAX_INTERVAL = 1 << 20;
+
+    clock::time_point start_time, deadline, last_check;
+    double tolerance;
+    int interval, countdown;
+    bool expired;
+    long long checks;
+
+    SearchClock(double tolerance = CLOCK_TOLERANCE) : tolerance(tolerance) {
+        start(INF);
+    }
+
+    void start(double seconds) {
+        start_time = clock::now();
+        const auto duration = std::chrono::duration<double>(std::min(seconds, 1e9));
+        deadline = start_time + std::chrono::duration_cast<clock::duration>(duration);
+        last_check = start_time;
+        interval = 1;
+        countdown = 1;
+        expired = false;
+        checks = 0;
+    }
+
+    bool exceeded() {
+        if (--countdown > 0) {
+            return expired;
+        }
+        return check();
+    }
+
+    // Reads the clock now and recalibrates the interval
+    bool check() {
+        ++checks;
+        const auto now = clock::now();
+        const int calls = interval - countdown;
+        const double seconds = std::chrono::duration<double>(now - last_check).count();
+        if (calls > 0) {
+            double target = MAX_INTERVAL;
+            if (seconds > 0) {
+                target = std::min<double>(target, std::max(1.0, 0.5 * tolerance * calls / seconds));
+            }
+            // grow slowly, as the calls can get slower, shrink at once
+            interval = std::min<double>(target, 2.0 * interval);
+        }
+        countdown = interval;
+        last_check = now;
+        expired = now >= deadline;
+        return expired;
+    }
+
+    double seconds_elapsed() const {
+        return std::chrono::duration<double>(clock::now() - start_time).count();
+    }
+
+    double get_overhead() const {
+        return checks * get_read_cost();
+    }
+
+    static double get_read_cost() {
+        static const double read_cost = measure_read_cost();
+        return read_cost;
+    }
+
+    static double measure_read_cost() {
+        const int READS = 1000;
+        const auto start = clock::now();
+        for (int i = 0; i < READS; ++i) {
+            clock::now();
+        }
+        return std::chrono::duration<double>(clock::now() - start).count() / READS;
+    }
+
+    friend ostream &operator<<(ostream &os, const SearchClock &timer) {
+        return os << std::setprecision(2) << std::fixed << timer.seconds_elapsed() << "s";
+    }
+};
+
+// Splits a game clock into limits for the move. No iteration starts past the soft limit,
+// nor one predicted to end past the hard limit, the deadline of the search clock.
+// The next iteration is predicted to take the last one times the effective branching factor,
+// the ratio of the last two. Best move changes extend the soft limit, as the search is unsure.
+// With moves_to_go = 1, hard_ratio = 1 and max_fraction = 1 remaining is the time of one move.
+struct TimeManager {
+    // Seconds left on the game clock, get_move subtracts its time and adds the increment,
+    // the caller can set it from the server instead
+    double remaining;
+    double increment;
+    // How many more moves the remaining time is split among, when the game length is unknown
+    int moves_to_go;
+    double hard_ratio;
+    // Of the remaining time, the most that a move can take
+    double max_fraction;
+    // Soft limit extension per recent best move change
+    double instability = 1;
+    double soft_limit = 0;
+    double hard_limit = 0;
+    double best_move_changes = 0;
+    vector<double> iteration_seconds;
+
+    TimeManager(double remaining, double increment = 0, int moves_to_go = 20, double hard_ratio = 3, double max_fraction = 0.25) :
+            remaining(remaining), increment(increment), moves_to_go(moves_to_go), hard_ratio(hard_ratio), max_fraction(max_fraction) {}
+
+    void start_move() {
+        const double available = std::max(0.0, remaining);
+        hard_limit = std::min(available * max_fraction + increment, available);
+        soft_limit = std::min(available / moves_to_go + increment, hard_limit);
+        hard_limit = std::min(hard_limit, soft_limit * hard_ratio);
+        best_move_changes = 0;
+        iteration_seconds.clear();
+    }
+
+    // Called after each completed iteration, changes of old iterations count less
+    void add_iteration(double seconds, bool best_move_changed) {
+        iteration_seconds.push_back(seconds);
+        best_move_changes = best_move_changes / 2 + best_move_changed;
+    }
+
+    // Iterations are timed as at least this long, shorter times are mostly noise
+    double min_iteration_seconds = 0.002;
+
+    double get_iteration_seconds(int i) const {
+        return std::max(min_iteration_seconds, iteration_seconds[i]);
+    }
+
+    // Predicted growth of the time from the last iteration to the next one. In games like Isola
+    // it alternates between odd and even depths, so it's taken from the step of the same parity,
+    // one iteration back, or from the mean over the last two steps if that's more.
+    double get_ebf() const {
+        const int size = iteration_seconds.size();
+        if (size < 2) {
+            return MAX_EBF;
+        }
+        double ebf = get_iteration_seconds(size - 1) / get_iteration_seconds(size - 2);
+        if (size >= 3) {
+            ebf = std::max(get_iteration_seconds(size - 2) / get_iteration_seconds(size - 3),
+                           sqrt(get_iteration_seconds(size - 1) / get_iteration_seconds(size - 3)));
+        }
+        return std::min(MAX_EBF, std::max(1.0, ebf));
+    }
+
+    double predict_next_iteration() const {
+        return iteration_seconds.empty() ? 0 : iteration_seconds.back() * get_ebf();
+    }
+
+    double get_extended_soft_limit() const {
+        return std::min(hard_limit, soft_limit * (1 + instability * best_move_changes));
+    }
+
+    bool can_start_iteration(double elapsed) const {
+        return elapsed < get_extended_soft_limit() && elapsed + predict_next_iteration() <= hard_limit;
+    }
+
+    void end_move(double elapsed) {
+        remaining += increment - elapsed;
+    }
+};
+
+// Fixed capacity list living on the stack, so that generating moves doesn't allocate
+template<class M, int N = MAX_LEGAL_MOVES>
+struct MoveList {
+    typename std::aligned_storage<sizeof(M), alignof(M)>::type items[N];
+    int count = 0;
+
+    MoveList() {}
+
+    MoveList(const MoveList &) = delete;
+
+    MoveList &operator=(const MoveList &) = delete;
+
+    virtual ~MoveList() {
+        clear();
+    }
+
+    void push_back(const M &move) {
+        assert(count < N);
+        new (&items[count++]) M(move);
+    }
+
+    M &operator[](int index) {
+        return *reinterpret_cast<M*>(&items[index]);
+    }
+
+    const M &operator[](int index) const {
+        return *reinterpret_cast<const M*>(&items[index]);
+    }
+
+    M *begin() {
+        return reinterpret_cast<M*>(&items[0]);
+    }
+
+    M *end() {
+        return begin() + count;
+    }
+
+    const M *begin() const {
+        return reinterpret_cast<const M*>(&items[0]);
+    }
+
+    const M *end() const {
+        return begin() + count;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void resize(int size) {
+        assert(size <= count);
+        while (count > size) {
+            (*this)[--count].~M();
+        }
+    }
+
+    void clear() {
+        resize(0);
+    }
+};
+
 template<class M>
 struct Move {
     virtual ~Move() {}
@@ -115,26 +393,72 @@ struct Move {
     virtual bool operator==(const M &rhs) const = 0;
 
     virtual size_t hash() const = 0;
+
+    // Optionally a move can also define
+    //   uint32_t pack() const;
+    //   static M unpack(uint32_t packed);
+    // (or uint16_t), encoding it losslessly in an integer. The transposition table and
+    // the MCTS children then keep the integer instead of the whole move with its vtable pointer.
+};
+
+// How tables store a move: the packed integer if M defines pack() and unpack(), otherwise M itself
+template<class M, class = void>
+struct MoveStorage {
+    typedef M type;
+
+    static const type &pack(const M &move) {
+        return move;
+    }
+
+    static const M &unpack(const type &packed) {
+        return packed;
+    }
+
+    static size_t get_key(const M &move) {
+        return move.hash();
+    }
+};
+
+template<class M>
+struct MoveStorage<M, typename std::enable_if<
+        std::is_integral<decltype(std::declval<const M&>().pack())>::value &&
+        std::is_same<decltype(M::unpack(std::declval<const M&>().pack())), M>::value>::type> {
+    typedef decltype(std::declval<const M&>().pack()) type;
+
+    static type pack(const M &move) {
+        return move.pack();
+    }
+
+    static M unpack(type packed) {
+        return M::unpack(packed);
+    }
+
+    // Packing is lossless, so unlike hash() the key never collides
+    static size_t get_key(const M &move) {
+        return move.pack();
+    }
 };
 
-enum TTEntryType { EXACT_VALUE, LOWER_BOUND, UPPER_BOUND };
+enum TTEntryType : uint8_t { EXACT_VALUE, LOWER_BOUND, UPPER_BOUND };
 
 template<class M>
 struct TTEntry {
-    M move;
-    int depth;
+    typename MoveStorage<M>::type move;
     int value;
+    int16_t depth;
     TTEntryType value_type;
 
     TTEntry() {}
 
-    virtual ~TTEntry() {}
-
     TTEntry(const M &move, int depth, int value, TTEntryType value_type) :
-            move(move), depth(depth), value(value), value_type(value_type) {}
+            move(MoveStorage<M>::pack(move)), value(value), depth(depth), value_type(value_type) {}
+
+    M get_move() const {
+        return MoveStorage<M>::unpack(move);
+    }
 
     ostream &to_stream(ostream &os) const {
-        return os << "move: " << move << " depth: " << depth << " value: " << value << " value_type: " << value_type;
+        return os << "move: " << get_move() << " depth: " << depth << " value: " << value << " value_type: " << (int) value_type;
     }
 
     friend ostream &operator<<(ostream &os, const TTEntry &entry) {
@@ -142,55 +466,293 @@ struct TTEntry {
     }
 };
 
-template<class S, class M>
-struct State {
-    unsigned visits = 5; // virtual visits
-    double score = 0;
-    int player_to_move = 0;
-    S *parent = nullptr;
-    unordered_map<size_t, shared_ptr<S>> children = unordered_map<size_t, shared_ptr<S>>();
-    const vector<int> teams;
+enum TTReplacement { DEPTH_PREFERRED, ALWAYS_REPLACE };
 
-    State(const vector<int> &teams) : teams(teams) {}
+enum TTStoreResult { STORED, UPDATED, REPLACED, REJECTED };
 
-    virtual ~State() {}
+// Transposition table snapshot file: a header, then one record per used slot
+static const char TT_MAGIC[8] = {'G', 'T', 'S', 'A', 'T', 'T', 'A', 'B'};
 
-    double get_uct(const int player) const {
-        assert(visits > 0);
-        double parent_visits = 0.0;
-        if (parent != nullptr) {
-            parent_visits = parent->visits;
+struct TTHeader {
+    char magic[8];
+    uint32_t record_size;
+    // The table keeps the low index_bits of a key in the bucket index and the high 32 in the slot,
+    // the bits in between are lost, so the snapshot fits only tables with as many buckets or less
+    uint32_t index_bits;
+    uint64_t variant;
+    uint64_t count;
+};
+
+template<class E>
+struct TTRecord {
+    uint64_t key;
+    // Hash of the key and the entry bytes, a damaged record is skipped
+    uint64_t check;
+    E entry;
+
+    uint64_t get_check() const {
+        return get_fnv_hash(&entry, sizeof(entry), key);
+    }
+};
+
+// Fixed size table shared by all search threads.
+// Memory is a power of two of cache line aligned buckets, so a probe touches one bucket.
+// The low bits of the key select the bucket, the high bits verify the entry.
+// A bucket is guarded by a try-lock flag: a thread that finds the bucket busy
+// treats it as a miss (or skips the store) instead of waiting, so no thread ever blocks.
+// Entries need a depth, the replacement keeps the deeper ones.
+template<class M, class E = TTEntry<M>>
+struct TranspositionTable {
+    struct Slot {
+        uint32_t check;
+        uint8_t generation;
+        bool used;
+        E entry;
+    };
+
+    // The busy flag takes the first alignof(Slot) bytes of a bucket, the slots fill the rest
+    static constexpr int SLOTS = (CACHE_LINE - alignof(Slot)) / sizeof(Slot) > 2 ? (CACHE_LINE - alignof(Slot)) / sizeof(Slot) : 2;
+
+    struct alignas(CACHE_LINE) Bucket {
+        std::atomic<bool> busy;
+        Slot slots[SLOTS];
+
+        Bucket() : busy(false) {
+            for (auto &slot : slots) {
+                slot.used = false;
+            }
         }
-        double ratio = score / visits;
-        if (player != player_to_move) {
-            ratio = (visits - score) / visits;
+    };
+
+    Bucket *buckets = nullptr;
+    size_t bucket_count;
+    size_t mask;
+    TTReplacement replacement;
+    uint8_t generation = 0;
+    std::atomic<size_t> filled;
+
+    TranspositionTable(int megabytes = TT_MEGABYTES, TTReplacement replacement = DEPTH_PREFERRED) :
+            replacement(replacement), filled(0) {
+        const size_t bytes = (size_t) megabytes << 20;
+        bucket_count = 1;
+        while (2 * bucket_count * sizeof(Bucket) <= bytes) {
+            bucket_count *= 2;
         }
-        return ratio + UCT_C * sqrt(log(parent_visits) / visits);
+        mask = bucket_count - 1;
+        void *memory = nullptr;
+        if (posix_memalign(&memory, CACHE_LINE, bucket_count * sizeof(Bucket)) != 0) {
+            throw std::bad_alloc();
+        }
+        buckets = static_cast<Bucket*>(memory);
+        for (size_t i = 0; i < bucket_count; ++i) {
+            new (&buckets[i]) Bucket();
+        }
+    }
+
+    TranspositionTable(const TranspositionTable &) = delete;
+
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    virtual ~TranspositionTable() {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            buckets[i].~Bucket();
+        }
+        free(buckets);
+    }
+
+    static uint32_t get_check(uint64_t key) {
+        return key >> 32;
+    }
+
+    bool get(uint64_t key, E &entry) {
+        Bucket &bucket = buckets[key & mask];
+        if (bucket.busy.exchange(true, std::memory_order_acquire)) {
+            return false;
+        }
+        const uint32_t check = get_check(key);
+        bool found = false;
+        for (auto &slot : bucket.slots) {
+            if (slot.used && slot.check == check) {
+                slot.generation = generation;
+                entry = slot.entry;
+                found = true;
+                break;
+            }
+        }
+        bucket.busy.store(false, std::memory_order_release);
+        return found;
+    }
+
+    TTStoreResult put(uint64_t key, const E &entry) {
+        Bucket &bucket = buckets[key & mask];
+        if (bucket.busy.exchange(true, std::memory_order_acquire)) {
+            return REJECTED;
+        }
+        const uint32_t check = get_check(key);
+        Slot *victim = nullptr;
+        TTStoreResult result = REJECTED;
+        for (auto &slot : bucket.slots) {
+            if (slot.used && slot.check == check) {
+                if (replacement == ALWAYS_REPLACE || entry.depth >= slot.entry.depth || slot.generation != generation) {
+                    victim = &slot;
+                    result = UPDATED;
+                }
+                break;
+            }
+            if (!slot.used) {
+                victim = &slot;
+                result = STORED;
+                break;
+            }
+            if (victim == nullptr || get_worth(slot) < get_worth(*victim)) {
+                victim = &slot;
+                result = REPLACED;
+            }
+        }
+        if (result == REPLACED && replacement == DEPTH_PREFERRED &&
+            victim->generation == generation && victim->entry.depth > entry.depth) {
+            result = REJECTED;
+        }
+        if (result != REJECTED) {
+            if (result == STORED) {
+                filled.fetch_add(1, std::memory_order_relaxed);
+            }
+            victim->check = check;
+            victim->generation = generation;
+            victim->used = true;
+            victim->entry = entry;
+        }
+        bucket.busy.store(false, std::memory_order_release);
+        return result;
+    }
+
+    // Entries from previous searches are worth less, so they are replaced first
+    int get_worth(const Slot &slot) const {
+        const uint8_t age = generation - slot.generation;
+        return slot.entry.depth - 4 * age;
+    }
+
+    void new_search() {
+        ++generation;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            for (auto &slot : buckets[i].slots) {
+                slot.used = false;
+            }
+        }
+        filled = 0;
+    }
+
+    size_t size() const {
+        return filled.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return bucket_count * SLOTS;
+    }
+
+    double get_fill_rate() const {
+        return (double) size() / capacity();
     }
 
-    shared_ptr<S> create_child(const M &move) {
-        S child = clone();
-        child.make_move(move);
-        child.parent = (S*) this;
-        return make_shared<S>(child);
+    int get_index_bits() const {
+        int bits = 0;
+        while ((size_t) 1 << bits < bucket_count) {
+            ++bits;
+        }
+        return bits;
     }
 
-    S* add_child(const M &move) {
-        const auto child = create_child(move);
-        const auto key = move.hash();
-        const auto pair = children.insert({key, child});
-        const auto it = pair.first;
-        return it->second.get();
+    // Writes the used slots, for a warm start of a later process. Call it between searches.
+    // variant identifies the game and its parameters, see State::get_variant.
+    void save(const string &path, const string &variant) const {
+        static_assert(std::is_trivially_copyable<E>::value, "Entries are written to the file as they are");
+        vector<TTRecord<E>> records;
+        records.reserve(size());
+        for (size_t i = 0; i < bucket_count; ++i) {
+            for (const auto &slot : buckets[i].slots) {
+                if (slot.used) {
+                    TTRecord<E> record{};
+                    record.key = (uint64_t) slot.check << 32 | i;
+                    record.entry = slot.entry;
+                    record.check = record.get_check();
+                    records.push_back(record);
+                }
+            }
+        }
+        TTHeader header = TTHeader();
+        memcpy(header.magic, TT_MAGIC, sizeof(TT_MAGIC));
+        header.record_size = sizeof(TTRecord<E>);
+        header.index_bits = get_index_bits();
+        header.variant = get_fnv_hash(variant.data(), variant.size());
+        header.count = records.size();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TTRecord<E>));
+        if (!file) {
+            throw runtime_error("Can't write transposition table: " + path);
+        }
     }
 
-    S* get_child(const M &move) const {
-        const auto key = move.hash();
-        const auto it = children.find(key);
-        if (it == children.end()) {
-            return nullptr;
+    // Stores the records of a saved file through put, so they compete with the entries already here.
+    // The file is mapped, not read. Returns how many records were valid.
+    size_t load(const string &path, const string &variant) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw runtime_error("Can't open transposition table: " + path);
+        }
+        void *memory = MAP_FAILED;
+        size_t bytes = 0;
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && (size_t) file_stat.st_size >= sizeof(TTHeader)) {
+            bytes = file_stat.st_size;
+            memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw runtime_error("Can't map transposition table: " + path);
+        }
+        const TTHeader *header = static_cast<const TTHeader*>(memory);
+        string error;
+        if (memcmp(header->magic, TT_MAGIC, sizeof(TT_MAGIC)) != 0 ||
+            header->record_size != sizeof(TTRecord<E>) ||
+            header->count > (bytes - sizeof(TTHeader)) / sizeof(TTRecord<E>)) {
+            error = "Invalid transposition table: ";
+        } else if (header->variant != get_fnv_hash(variant.data(), variant.size())) {
+            error = "Transposition table of another game variant: ";
+        } else if ((int) header->index_bits < get_index_bits()) {
+            error = "Transposition table of a smaller table: ";
+        }
+        if (!error.empty()) {
+            munmap(memory, bytes);
+            throw runtime_error(error + path);
         }
-        return it->second.get();
+        const TTRecord<E> *records = reinterpret_cast<const TTRecord<E>*>(static_cast<const char*>(memory) + sizeof(TTHeader));
+        size_t loaded = 0;
+        for (size_t i = 0; i < header->count; ++i) {
+            if (records[i].check == records[i].get_check()) {
+                put(records[i].key, records[i].entry);
+                ++loaded;
+            }
+        }
+        munmap(memory, bytes);
+        return loaded;
     }
+};
+
+template<class S, class M>
+struct State {
+    int player_to_move = 0;
+    // Optional incremental hashing: make_move and undo_move keep the key up to date in O(1)
+    // and hash() returns it instead of hashing the whole state.
+    uint64_t zobrist = 0;
+    const vector<int> teams;
+
+    State(const vector<int> &teams) : teams(teams) {}
+
+    virtual ~State() {}
 
     int get_next_player(int player) const {
         return (player + 1) % teams.size();
@@ -200,6 +762,15 @@ struct State {
         return (player > 0) ? (player - 1) : (teams.size() - 1);
     }
 
+    // The first player after the given one that isn't on its team
+    int get_next_enemy(int player) const {
+        int next = get_next_player(player);
+        for (int i = 1; i < teams.size() && teams[next] == teams[player]; ++i) {
+            next = get_next_player(next);
+        }
+        return next;
+    }
+
     bool is_team_mate(int index) const {
         return teams[player_to_move] == teams[index];
     }
@@ -226,6 +797,38 @@ struct State {
 
     virtual vector<M> get_legal_moves(int max_moves) const = 0;
 
+    // Generates the moves into a caller provided buffer, without allocating.
+    // By default copies the moves from the above, override to avoid the allocation.
+    virtual void get_legal_moves(MoveList<M> &moves, int max_moves) const {
+        for (const auto &move : get_legal_moves(max_moves)) {
+            moves.push_back(move);
+        }
+    }
+
+    // Optional, moves that resolve a volatile position (a capture, a threat), searched by Minimax
+    // beyond its horizon until the position is quiet. Returns whether the player to move
+    // could keep the static goodness instead of playing one of them (stand pat).
+    // When all its moves are forced, generate them and return false.
+    virtual bool get_noisy_moves(MoveList<M> &moves) const {
+        return true;
+    }
+
+    // Optional, for null move pruning: whether giving the turn away is never better than moving,
+    // so that a pass gives a lower bound. Don't allow it in zugzwang prone positions.
+    virtual bool can_pass() const {
+        return false;
+    }
+
+    virtual void make_pass() {}
+
+    virtual void undo_pass() {}
+
+    // Optional, exact goodness of a position that a game specific solver decides before it's terminal,
+    // in the get_goodness scale. Returns whether it could. Minimax and MCTS rollouts stop there.
+    virtual bool get_solved_goodness(int &goodness) const {
+        return false;
+    }
+
     virtual bool is_terminal() const = 0;
 
     virtual bool is_winner(int player) const = 0;
@@ -243,6 +846,17 @@ struct State {
     virtual bool operator==(const S &other) const = 0;
 
     virtual size_t hash() const = 0;
+
+    // Computes the incremental key from scratch, to initialize and verify zobrist
+    virtual uint64_t compute_zobrist() const {
+        return 0;
+    }
+
+    // Identifies the game and its parameters in saved files, so that a file of another variant
+    // is rejected. Override it to add the parameters the type doesn't tell, like the board size.
+    virtual string get_variant() const {
+        return string(typeid(S).name()) + " players: " + to_string(teams.size());
+    }
 };
 
 template<class S, class M>
@@ -256,7 +870,7 @@ struct Algorithm {
 
     virtual ~Algorithm() {}
 
-    string read_log() {
+    virtual string read_log() {
         string result = log.str();
         log.str("");
         return result;
@@ -266,6 +880,18 @@ struct Algorithm {
 
     virtual M get_move(const S *state) = 0;
 
+    // Evaluation of the position of the last get_move for the player to move, in the algorithm's own scale
+    virtual int get_score() const {
+        return 0;
+    }
+
+    // Pondering: thinking on the opponent's time. Called with the state after our move,
+    // searches in the background until stop_ponder or the next get_move,
+    // which uses the work if the opponent replied as predicted and discards it otherwise.
+    virtual void start_ponder(const S *state) {}
+
+    virtual void stop_ponder() {}
+
     virtual string get_name() const = 0;
 
     friend ostream &operator<<(ostream &os, const Algorithm &algorithm) {
@@ -368,36 +994,225 @@ struct MinimaxResult {
     bool completed;
 };
 
+// Counters of one search iteration, or summed over a move or many games.
+// Formatted only when written to a stream.
+struct SearchStats {
+    long long scout_cuts = 0;
+    long long beta_cuts = 0, cut_bf_sum = 0;
+    long long tt_hits = 0, tt_exacts = 0, tt_cuts = 0;
+    long long tt_replaced = 0, tt_rejected = 0;
+    long long nodes = 0, leafs = 0;
+    long long researches = 0;
+    long long passes = 0;
+    long long qnodes = 0, qcuts = 0;
+    long long null_tries = 0, null_cuts = 0;
+    long long lmr_reductions = 0, lmr_researches = 0;
+    long long solved = 0;
+    long long clock_checks = 0;
+    // Time spent, on this iteration alone or summed
+    double seconds = 0;
+    // Deepest completed iteration
+    int depth = 0;
+    // Snapshots at the end of the iteration or move, not summed
+    int goodness = 0;
+    int pv_length = 0;
+    size_t tt_size = 0;
+    double tt_fill = 0;
+
+    SearchStats &operator+=(const SearchStats &other) {
+        scout_cuts += other.scout_cuts;
+        beta_cuts += other.beta_cuts;
+        cut_bf_sum += other.cut_bf_sum;
+        tt_hits += other.tt_hits;
+        tt_exacts += other.tt_exacts;
+        tt_cuts += other.tt_cuts;
+        tt_replaced += other.tt_replaced;
+        tt_rejected += other.tt_rejected;
+        nodes += other.nodes;
+        leafs += other.leafs;
+        researches += other.researches;
+        passes += other.passes;
+        qnodes += other.qnodes;
+        qcuts += other.qcuts;
+        null_tries += other.null_tries;
+        null_cuts += other.null_cuts;
+        lmr_reductions += other.lmr_reductions;
+        lmr_researches += other.lmr_researches;
+        solved += other.solved;
+        clock_checks += other.clock_checks;
+        seconds += other.seconds;
+        depth = std::max(depth, other.depth);
+        return *this;
+    }
+
+    double get_nps() const {
+        return seconds > 0 ? nodes / seconds : 0;
+    }
+
+    double get_cut_bf() const {
+        return beta_cuts > 0 ? (double) cut_bf_sum / beta_cuts : 0;
+    }
+
+    double get_clock_overhead() const {
+        return clock_checks * SearchClock::get_read_cost();
+    }
+
+    friend ostream &operator<<(ostream &os, const SearchStats &stats) {
+        return os << "nodes: " << stats.nodes
+               << " leafs: " << stats.leafs
+               << " scout_cuts: " << stats.scout_cuts
+               << " beta_cuts: " << stats.beta_cuts
+               << " cutBF: " << stats.get_cut_bf()
+               << " tt_hits: " << stats.tt_hits
+               << " tt_exacts: " << stats.tt_exacts
+               << " tt_cuts: " << stats.tt_cuts
+               << " tt_replaced: " << stats.tt_replaced
+               << " tt_rejected: " << stats.tt_rejected
+               << " researches: " << stats.researches
+               << " passes: " << stats.passes
+               << " qnodes: " << stats.qnodes
+               << " qcuts: " << stats.qcuts
+               << " null_tries: " << stats.null_tries
+               << " null_cuts: " << stats.null_cuts
+               << " lmr_reductions: " << stats.lmr_reductions
+               << " lmr_researches: " << stats.lmr_researches
+               << " solved: " << stats.solved
+               << " tt_size: " << stats.tt_size
+               << " tt_fill: " << stats.tt_fill
+               << " clock_checks: " << stats.clock_checks
+               << " clock_overhead: " << (int) (1e6 * stats.get_clock_overhead()) << "us"
+               << " nps: " << (long long) stats.get_nps();
+    }
+};
+
 template<class S, class M>
 struct Minimax : public Algorithm<S, M> {
-    unordered_map<size_t, TTEntry<M>> transposition_table;
+    shared_ptr<TranspositionTable<M>> transposition_table;
     const double MAX_SECONDS;
     const int MAX_MOVES;
     function<vector<M>(const S*, int)> get_legal_moves;
     function<int(const S*)> get_goodness;
-    Timer timer;
-    int scout_cuts;
-    int beta_cuts, cut_bf_sum;
-    int tt_hits, tt_exacts, tt_cuts;
-    int nodes, leafs;
+    SearchClock timer;
+    SearchStats stats;
+    // Statistics of the last get_move: one entry per completed iteration, with its best move,
+    // and the total over all iterations and threads
+    vector<SearchStats> iterations;
+    vector<M> iteration_moves;
+    SearchStats total_stats;
+    // Whether read_log still has to format the statistics of the last get_move
+    bool log_pending = false;
     const int verbose;
+    // Lazy SMP: helper threads run their own iterative deepening over the shared transposition table
+    const int threads;
+    int thread_id = 0;
+    shared_ptr<std::atomic<bool>> stopped;
+    // Move ordering: the transposition table move, then killer moves of the ply, then by history
+    bool use_hash_move = true;
+    bool use_killers = true;
+    bool use_history = true;
+    vector<vector<M>> killers;
+    vector<int> history;
+    int ply = 0;
+    // Aspiration windows: search around the previous goodness, on a fail widen the window by the factor.
+    // The right width depends on the scale of get_goodness, 0 searches with the full window.
+    int aspiration_window = 0;
+    int aspiration_widening = 4;
+    // MTD(f) instead of NegaScout at the root: null window searches around the guess, each one
+    // a bound on the goodness, until the bounds meet. The transposition table keeps the passes cheap.
+    bool use_mtdf = false;
+    int mtdf_widening = 2;
+    // How many noisy moves deep quiescence search goes past the horizon, 0 evaluates there right away
+    int quiescence_depth = QUIESCENCE_DEPTH;
+    // Forward pruning, only at null window nodes. Null move: if passing still fails high
+    // at a search reduced by null_move_reduction, so would a real move. State::can_pass() gates it.
+    // Late move reductions: moves after the first lmr_moves (and after the hash move and killers)
+    // are searched lmr_reduction shallower, those that don't fail low get verified at full depth.
+    // Even reductions keep the parity of the horizon, an odd one compares goodness of different sides.
+    bool use_null_move = false;
+    int null_move_reduction = 2;
+    bool use_lmr = false;
+    int lmr_moves = 3;
+    int lmr_reduction = 2;
+    // Team aware (paranoid) search: goodness is always from the point of view of the team to move,
+    // so when a teammate moves next the child keeps our window and sign. Otherwise every ply
+    // is searched as if the sides alternated, which is right only when the teams do.
+    bool use_teams = true;
+    // Positions State::get_solved_goodness decides are leaves, except the root, which needs a move
+    bool use_solver = true;
+    // The transposition table, killers and history are kept between moves, the next search
+    // is usually two plies deeper into the same line. Entries of previous searches age out of the table.
+    bool reuse_tables = true;
+    // Triangular table, the line at ply p starts at pv_table[p * MAX_PLY] and has pv_length[p] moves
+    vector<M> pv_table;
+    vector<int> pv_length;
+    // Principal variation of the last completed iteration, starting with the move get_move returned
+    vector<M> pv;
+    // Pondering searches the reply predicted by pv into the shared transposition table,
+    // so on a hit get_move starts with the table filled ahead.
+    shared_ptr<std::thread> ponder_thread;
+    shared_ptr<S> ponder_state;
+    // Game clock mode: limits come from the time manager instead of MAX_SECONDS,
+    // iterations that can't finish aren't started and forced moves are played at once
+    shared_ptr<TimeManager> time_manager;
 
     Minimax(double max_seconds = 1,
             int max_moves = INF,
             function<vector<M>(const S*, int)> get_legal_moves = nullptr,
             function<int(const S*)> get_goodness = nullptr,
-            int verbose = 0) :
+            int verbose = 0,
+            int threads = 1,
+            int tt_megabytes = TT_MEGABYTES) :
         Algorithm<S, M>(),
-        transposition_table(1000000),
+        transposition_table(make_shared<TranspositionTable<M>>(tt_megabytes)),
         MAX_SECONDS(max_seconds),
         MAX_MOVES(max_moves),
         get_legal_moves(get_legal_moves),
         get_goodness(get_goodness),
+        timer(SearchClock()),
         verbose(verbose),
-        timer(Timer()) {}
+        threads(threads),
+        stopped(make_shared<std::atomic<bool>>(false)),
+        killers(MAX_PLY),
+        history(HISTORY_SIZE),
+        pv_table(MAX_PLY * MAX_PLY),
+        pv_length(MAX_PLY) {
+        for (auto &ply_killers : killers) {
+            ply_killers.reserve(KILLERS + 1);
+        }
+    }
+
+    virtual ~Minimax() {
+        stop_ponder();
+    }
 
     void reset() {
-        transposition_table.clear();
+        if (!reuse_tables) {
+            clear();
+        }
+    }
+
+    // Warm start: the table is saved at the end of a game and loaded before the first move of the next one.
+    // Values are in the get_goodness scale, so both processes need the same evaluation.
+    void save_transposition_table(const string &path, const S *state) {
+        stop_ponder();
+        transposition_table->save(path, state->get_variant());
+    }
+
+    size_t load_transposition_table(const string &path, const S *state) {
+        stop_ponder();
+        const size_t loaded = transposition_table->load(path, state->get_variant());
+        this->log << "tt loaded: " << loaded << " tt_size: " << transposition_table->size() << endl;
+        return loaded;
+    }
+
+    void clear() {
+        stop_ponder();
+        transposition_table->clear();
+        for (auto &ply_killers : killers) {
+            ply_killers.clear();
+        }
+        std::fill(history.begin(), history.end(), 0);
+        pv.clear();
     }
 
     M get_move(const S *state) override {
@@ -406,15 +1221,34 @@ struct Minimax : public Algorithm<S, M> {
             state->to_stream(stream);
             throw invalid_argument("Given state is terminal:\n" + stream.str());
         }
-        if (get_legal_moves == nullptr) {
-            get_legal_moves = &State<S,M>::get_legal_moves;
-        }
         if (get_goodness == nullptr) {
             get_goodness = &State<S,M>::get_goodness;
         }
-        timer.start();
-
-        const auto moves = get_legal_moves(state, MAX_MOVES);
+        if (ponder_thread != nullptr) {
+            const bool ponder_hit = *ponder_state == *state;
+            stop_ponder();
+            this->log << "ponder: " << (ponder_hit ? "hit" : "miss") << endl;
+        }
+        if (time_manager != nullptr) {
+            time_manager->start_move();
+            timer.start(time_manager->hard_limit);
+        } else {
+            timer.start(MAX_SECONDS);
+        }
+        transposition_table->new_search();
+        // Old history still orders moves, but the new search should be able to outweigh it
+        for (auto &score : history) {
+            score /= 2;
+        }
+        *stopped = false;
+        total_stats = SearchStats();
+        iterations.clear();
+        iteration_moves.clear();
+        log_pending = true;
+        ply = 0;
+
+        MoveList<M> moves;
+        generate_moves(state, moves);
         this->log << "moves: " << moves.size() << endl;
         if (verbose > 1) {
             for (const auto move : moves) {
@@ -422,62 +1256,315 @@ struct Minimax : public Algorithm<S, M> {
             }
             this->log << endl;
         }
+        if (time_manager != nullptr && moves.size() == 1) {
+            this->log << "forced move: " << moves[0] << endl;
+            pv.assign(1, moves[0]);
+            time_manager->end_move(timer.seconds_elapsed());
+            return moves[0];
+        }
+
+        vector<Minimax> helpers;
+        helpers.reserve(threads);
+        vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            helpers.push_back(*this);
+            helpers.back().thread_id = i;
+            workers.emplace_back(&Minimax::helper_search, &helpers.back(), state);
+        }
 
         M best_move;
+        int goodness = 0;
+        int previous_goodness = 0;
+        double elapsed = 0;
         for (int max_depth = 1; max_depth <= MAX_DEPTH; ++max_depth) {
-            scout_cuts = 0;
-            beta_cuts = 0;
-            cut_bf_sum = 0;
-            tt_hits = 0;
-            tt_exacts = 0;
-            tt_cuts = 0;
-            nodes = 0;
-            leafs = 0;
+            stats = SearchStats();
+            const long long checks = timer.checks;
             S clone = state->clone();
-            auto result = minimax(&clone, max_depth, -INF, INF);
+            auto result = root_search(&clone, max_depth, goodness, previous_goodness);
+            const double now = timer.seconds_elapsed();
+            stats.seconds = now - elapsed;
+            stats.clock_checks = timer.checks - checks;
+            elapsed = now;
+            total_stats += stats;
             if (result.completed) {
                 best_move = result.best_move;
-                this->log << "goodness: " << result.goodness
-                << " time: " << timer
-                << " move: " << best_move
-                << " nodes: " << nodes
-                << " leafs: " << leafs
-                << " scout_cuts: " << scout_cuts
-                << " beta_cuts: " << beta_cuts
-                << " cutBF: " << (double) cut_bf_sum / beta_cuts
-                << " tt_hits: " << tt_hits
-                << " tt_exacts: " << tt_exacts
-                << " tt_cuts: " << tt_cuts
-                << " tt_size: " << transposition_table.size()
-                << " max_depth: " << max_depth << endl;
-            }
-            if (timer.exceeded(MAX_SECONDS)) {
+                previous_goodness = goodness;
+                goodness = result.goodness;
+                update_root_pv(state, max_depth);
+                stats.pv_length = pv.size();
+                stats.depth = max_depth;
+                stats.goodness = goodness;
+                stats.tt_size = transposition_table->size();
+                stats.tt_fill = transposition_table->get_fill_rate();
+                iterations.push_back(stats);
+                iteration_moves.push_back(best_move);
+                if (time_manager != nullptr) {
+                    const int size = iteration_moves.size();
+                    time_manager->add_iteration(stats.seconds, size > 1 && !(iteration_moves[size - 1] == iteration_moves[size - 2]));
+                    if (!time_manager->can_start_iteration(now)) {
+                        break;
+                    }
+                }
+            }
+            if (timer.check()) {
                 break;
             }
         }
+
+        *stopped = true;
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        total_stats.seconds = timer.seconds_elapsed();
+        total_stats.clock_checks = timer.checks;
+        for (const auto &helper : helpers) {
+            total_stats += helper.total_stats;
+        }
+        if (!iterations.empty()) {
+            total_stats.depth = iterations.back().depth;
+            total_stats.goodness = iterations.back().goodness;
+        }
+        total_stats.tt_size = transposition_table->size();
+        total_stats.tt_fill = transposition_table->get_fill_rate();
+        if (time_manager != nullptr) {
+            this->log << std::setprecision(2) << std::fixed
+                      << "soft limit: " << time_manager->soft_limit << "s"
+                      << " hard limit: " << time_manager->hard_limit << "s"
+                      << " time: " << total_stats.seconds << "s" << endl;
+            time_manager->end_move(total_stats.seconds);
+        }
         return best_move;
     }
 
-    // Find Minimax value of the given tree,
-    // Minimax value lies within a range of [alpha; beta] window.
-    // Whenever alpha >= beta, further checks of children in a node can be pruned.
-    MinimaxResult<M> minimax(S *state, int depth, int alpha, int beta) {
-        ++nodes;
-        const int alpha_original = alpha;
+    // Formats the statistics of the last get_move, only when somebody reads them
+    string read_log() override {
+        if (log_pending) {
+            log_pending = false;
+            double elapsed = 0;
+            for (int i = 0; i < iterations.size(); ++i) {
+                elapsed += iterations[i].seconds;
+                this->log << "goodness: " << iterations[i].goodness
+                << " time: " << std::setprecision(2) << std::fixed << elapsed << "s"
+                << " move: " << iteration_moves[i]
+                << " " << iterations[i]
+                << " max_depth: " << iterations[i].depth
+                << " pv_length: " << iterations[i].pv_length << endl;
+            }
+            if (threads > 1) {
+                this->log << "threads: " << threads
+                << " time: " << total_stats.seconds << "s"
+                << " " << total_stats << endl;
+            }
+            if (verbose > 0) {
+                this->log << "pv: ";
+                for (const auto &move : pv) {
+                    this->log << move << ", ";
+                }
+                this->log << endl;
+            }
+        }
+        return Algorithm<S, M>::read_log();
+    }
+
+    // The triangular table loses the tail of the line where the transposition table cut the search,
+    // the tail is then followed through the hash moves, as long as they are legal.
+    void update_root_pv(const S *state, int depth) {
+        pv.assign(pv_table.begin(), pv_table.begin() + pv_length[0]);
+        S clone = state->clone();
+        for (const auto &move : pv) {
+            clone.make_move(move);
+        }
+        TTEntry<M> entry;
+        while (pv.size() < depth && !clone.is_terminal() && get_tt_entry(&clone, entry)) {
+            const M move = entry.get_move();
+            MoveList<M> legal_moves;
+            generate_moves(&clone, legal_moves);
+            if (find(legal_moves.begin(), legal_moves.end(), move) == legal_moves.end()) {
+                break;
+            }
+            pv.push_back(move);
+            clone.make_move(move);
+        }
+    }
+
+    void update_pv(const M &move) {
+        assert(ply + 1 < MAX_PLY);
+        M *line = &pv_table[ply * MAX_PLY];
+        const M *child_line = &pv_table[(ply + 1) * MAX_PLY];
+        const int child_length = std::min(pv_length[ply + 1], MAX_PLY - 1);
+        line[0] = move;
+        std::copy(child_line, child_line + child_length, line + 1);
+        pv_length[ply] = child_length + 1;
+    }
+
+    void start_ponder(const S *state) override {
+        stop_ponder();
+        if (pv.size() < 2 || state->is_terminal()) {
+            return;
+        }
+        const M reply = pv[1];
+        MoveList<M> legal_moves;
+        generate_moves(state, legal_moves);
+        if (find(legal_moves.begin(), legal_moves.end(), reply) == legal_moves.end()) {
+            return;
+        }
+        ponder_state = make_shared<S>(state->clone());
+        ponder_state->make_move(reply);
+        if (ponder_state->is_terminal()) {
+            return;
+        }
+        if (get_goodness == nullptr) {
+            get_goodness = &State<S,M>::get_goodness;
+        }
+        timer.start(INF);
+        transposition_table->new_search();
+        *stopped = false;
+        total_stats = SearchStats();
+        ply = 0;
+        ponder_thread = make_shared<std::thread>(&Minimax::helper_search, this, ponder_state.get());
+    }
+
+    void stop_ponder() override {
+        if (ponder_thread == nullptr) {
+            return;
+        }
+        *stopped = true;
+        ponder_thread->join();
+        ponder_thread = nullptr;
+        this->log << "ponder nodes: " << total_stats.nodes << " time: " << timer << endl;
+    }
+
+    // Helpers start at staggered depths, so that they fill the table ahead of the main thread.
+    void helper_search(const S *state) {
+        S clone = state->clone();
+        int goodness = 0;
+        int previous_goodness = 0;
+        for (int max_depth = 1 + thread_id % 2; max_depth <= MAX_DEPTH && !is_time_up(); ++max_depth) {
+            stats = SearchStats();
+            const auto result = root_search(&clone, max_depth, goodness, previous_goodness);
+            if (result.completed) {
+                previous_goodness = goodness;
+                goodness = result.goodness;
+            }
+            total_stats += stats;
+        }
+    }
+
+    // The goodness of the last two iterations, when the side to move at the horizon alternates,
+    // so does the goodness, then the one before last is the better guess for MTD(f)
+    MinimaxResult<M> root_search(S *state, int depth, int goodness, int previous_goodness) {
+        if (use_mtdf) {
+            return mtdf_search(state, depth, depth > 2 ? previous_goodness : goodness);
+        }
+        return aspiration_search(state, depth, goodness);
+    }
+
+    MinimaxResult<M> aspiration_search(S *state, int depth, int guess) {
+        if (aspiration_window <= 0 || depth == 1) {
+            ++stats.passes;
+            return minimax(state, depth, -INF, INF);
+        }
+        long long delta = aspiration_window;
+        long long alpha = std::max<long long>(-INF, guess - delta);
+        long long beta = std::min<long long>(INF, guess + delta);
+        while (true) {
+            ++stats.passes;
+            const auto result = minimax(state, depth, alpha, beta);
+            if (!result.completed) {
+                return result;
+            }
+            delta *= aspiration_widening;
+            if (result.goodness <= alpha && alpha > -INF) {
+                alpha = std::max<long long>(-INF, guess - delta);
+            } else if (result.goodness >= beta && beta < INF) {
+                beta = std::min<long long>(INF, guess + delta);
+            } else {
+                return result;
+            }
+            ++stats.researches;
+        }
+    }
+
+    // A pass that fails low only bounds the moves from above, so the best move
+    // and the principal variation come from the last pass that failed high.
+    // Passes failing the same way in a row take growing steps, a big change in goodness
+    // (a win found) would otherwise take one pass per point.
+    MinimaxResult<M> mtdf_search(S *state, int depth, int guess) {
+        long long lower = -INF;
+        long long upper = INF;
+        long long beta = guess;
+        long long step = 1;
+        int last_fail = 0;
+        MinimaxResult<M> best = {guess, M(), false};
+        int best_pv_length = 0;
+        bool found = false;
+        while (lower < upper) {
+            ++stats.passes;
+            const auto result = minimax(state, depth, beta - 1, beta);
+            if (!result.completed) {
+                return result;
+            }
+            const int goodness = result.goodness;
+            const int fail = goodness < beta ? -1 : 1;
+            step = fail == last_fail ? step * mtdf_widening : 1;
+            last_fail = fail;
+            if (fail < 0) {
+                upper = goodness;
+                beta = std::max(lower + 1, goodness - step + 1);
+            } else {
+                lower = goodness;
+                beta = std::min(upper, goodness + step);
+                best = result;
+                best_pv_length = pv_length[0];
+                found = true;
+            }
+            if (!found) {
+                best = result;
+            }
+            best.goodness = goodness;
+        }
+        pv_length[0] = best_pv_length;
+        return best;
+    }
+
+    bool is_time_up() {
+        return stopped->load(std::memory_order_relaxed) || timer.exceeded();
+    }
+
+    // Find Minimax value of the given tree,
+    // Minimax value lies within a range of [alpha; beta] window.
+    // Whenever alpha >= beta, further checks of children in a node can be pruned.
+    // can_pass is false right after a null move, so that two passes in a row don't cancel out.
+    MinimaxResult<M> minimax(S *state, int depth, int alpha, int beta, bool can_pass = true) {
+        ++stats.nodes;
+        const int alpha_original = alpha;
+        const bool pv_node = beta - alpha > 1;
+        pv_length[ply] = 0;
 
         M best_move;
-        if (depth == 0 || state->is_terminal()) {
-            ++leafs;
+        if (state->is_terminal()) {
+            ++stats.leafs;
             return {get_goodness(state), best_move, false};
         }
+        int solved_goodness;
+        if (use_solver && ply > 0 && state->get_solved_goodness(solved_goodness)) {
+            ++stats.leafs;
+            ++stats.solved;
+            return {solved_goodness, best_move, false};
+        }
+        if (depth == 0) {
+            ++stats.leafs;
+            return {quiescence(state, quiescence_depth, alpha, beta), best_move, false};
+        }
 
         TTEntry<M> entry;
         const bool entry_found = get_tt_entry(state, entry);
-        if (entry_found && entry.depth >= depth) {
-            ++tt_hits;
+        // Not at the root, so that it has a principal variation and a move even on a hit
+        if (entry_found && entry.depth >= depth && ply > 0) {
+            ++stats.tt_hits;
             if (entry.value_type == TTEntryType::EXACT_VALUE) {
-                ++tt_exacts;
-                return {entry.value, entry.move, true};
+                ++stats.tt_exacts;
+                return {entry.value, entry.get_move(), true};
             }
             if (entry.value_type == TTEntryType::LOWER_BOUND && alpha < entry.value) {
                 alpha = entry.value;
@@ -486,59 +1573,127 @@ struct Minimax : public Algorithm<S, M> {
                 beta = entry.value;
             }
             if (alpha >= beta) {
-                ++tt_cuts;
-                return {entry.value, entry.move, true};
+                ++stats.tt_cuts;
+                return {entry.value, entry.get_move(), true};
+            }
+        }
+
+        if (use_null_move && can_pass && !pv_node && depth > null_move_reduction &&
+            state->can_pass() && get_goodness(state) >= beta) {
+            ++stats.null_tries;
+            const int mover = state->player_to_move;
+            state->make_pass();
+            ++ply;
+            const int goodness = search_child(
+                state,
+                depth - 1 - null_move_reduction,
+                beta - 1,
+                beta,
+                is_team_mate(state, mover),
+                false
+            );
+            --ply;
+            state->undo_pass();
+            if (goodness >= beta) {
+                ++stats.null_cuts;
+                return {goodness, best_move, true};
             }
         }
 
         int max_goodness = -INF;
 
         bool completed = true;
-        const auto legal_moves = get_legal_moves(state, MAX_MOVES);
+        MoveList<M> legal_moves;
+        generate_moves(state, legal_moves);
         assert(!legal_moves.empty());
+        int scores[MAX_LEGAL_MOVES];
+        const M hash_move = entry_found ? entry.get_move() : M();
+        const int ordered = order_moves(legal_moves, entry_found ? &hash_move : nullptr);
+        bool picking = use_history;
         for (int i = 0; i < legal_moves.size(); i++) {
+            if (i >= ordered && picking) {
+                if (i == ordered) {
+                    score_moves(legal_moves, scores, i);
+                }
+                if (i < ordered + LAZY_PICKS) {
+                    picking = pick_move(legal_moves, scores, i);
+                } else {
+                    sort_moves(legal_moves, scores, i);
+                    picking = false;
+                }
+            }
             const auto move = legal_moves[i];
+            const int mover = state->player_to_move;
             state->make_move(move);
+            ++ply;
+            const bool team_mate = is_team_mate(state, mover);
             int goodness;
             if (i > 0) {
-                // null window search
-                goodness = -minimax(
-                    state,
-                    depth - 1,
-                    -alpha - 1,
-                    -alpha
-                ).goodness;
-                if (alpha < goodness && goodness < beta) {
-                    // failed high, do a full re-search
-                    goodness = -minimax(
+                bool reduced = use_lmr && !pv_node && i >= lmr_moves && i >= ordered && depth > lmr_reduction + 1;
+                if (reduced) {
+                    ++stats.lmr_reductions;
+                    goodness = search_child(
+                        state,
+                        depth - 1 - lmr_reduction,
+                        alpha,
+                        alpha + 1,
+                        team_mate
+                    );
+                    if (alpha < goodness) {
+                        // the reduced search didn't prove the move is worse, verify at full depth
+                        ++stats.lmr_researches;
+                        reduced = false;
+                    }
+                }
+                if (!reduced) {
+                    // null window search
+                    goodness = search_child(
                         state,
                         depth - 1,
-                        -beta,
-                        -goodness
-                    ).goodness;
-                } else {
-                    scout_cuts++;
+                        alpha,
+                        alpha + 1,
+                        team_mate
+                    );
+                    if (alpha < goodness && goodness < beta) {
+                        // failed high, do a full re-search
+                        goodness = search_child(
+                            state,
+                            depth - 1,
+                            goodness,
+                            beta,
+                            team_mate
+                        );
+                    } else {
+                        stats.scout_cuts++;
+                    }
                 }
             }
             else {
-                goodness = -minimax(
+                goodness = search_child(
                     state,
                     depth - 1,
-                    -beta,
-                    -alpha
-                ).goodness;
+                    alpha,
+                    beta,
+                    team_mate
+                );
             }
+            --ply;
             state->undo_move(move);
-            if (timer.exceeded(MAX_SECONDS)) {
+            if (is_time_up()) {
                 completed = false;
                 break;
             }
             if (max_goodness < goodness) {
                 max_goodness = goodness;
                 best_move = move;
+                if (alpha < goodness) {
+                    update_pv(move);
+                }
                 if (max_goodness >= beta) {
-                    ++beta_cuts;
-                    cut_bf_sum += i + 1;
+                    ++stats.beta_cuts;
+                    stats.cut_bf_sum += i + 1;
+                    add_killer(move);
+                    history[get_history_index(move)] += depth * depth;
                     break;
                 }
             }
@@ -554,19 +1709,173 @@ struct Minimax : public Algorithm<S, M> {
         return {max_goodness, best_move, completed};
     }
 
-    bool get_tt_entry(const S *state, TTEntry<M> &entry) const {
-        const auto key = state->hash();
-        const auto it = transposition_table.find(key);
-        if (it == transposition_table.end()) {
+    // Goodness of the state after a move, from the point of view of the player who made it,
+    // searched within [alpha; beta] of that player
+    int search_child(S *state, int depth, int alpha, int beta, bool team_mate, bool can_pass = true) {
+        if (team_mate) {
+            return minimax(state, depth, alpha, beta, can_pass).goodness;
+        }
+        return -minimax(state, depth, -beta, -alpha, can_pass).goodness;
+    }
+
+    // Whether the player to move now is on the team of the one who just moved
+    bool is_team_mate(const S *state, int mover) const {
+        return use_teams && state->is_team_mate(mover);
+    }
+
+    // Resolves noisy moves at the horizon, so that the goodness isn't taken in the middle of a fight
+    int quiescence(S *state, int depth, int alpha, int beta) {
+        ++stats.qnodes;
+        const int stand_pat = get_goodness(state);
+        if (depth == 0 || state->is_terminal()) {
+            return stand_pat;
+        }
+        MoveList<M> noisy_moves;
+        const State<S, M> *base = state;
+        const bool can_stand_pat = base->get_noisy_moves(noisy_moves);
+        if (noisy_moves.empty()) {
+            return stand_pat;
+        }
+        int max_goodness = -INF;
+        if (can_stand_pat) {
+            if (stand_pat >= beta) {
+                ++stats.qcuts;
+                return stand_pat;
+            }
+            max_goodness = stand_pat;
+            alpha = std::max(alpha, stand_pat);
+        }
+        for (const auto &move : noisy_moves) {
+            const int mover = state->player_to_move;
+            state->make_move(move);
+            const int goodness = is_team_mate(state, mover) ?
+                                 quiescence(state, depth - 1, alpha, beta) :
+                                 -quiescence(state, depth - 1, -beta, -alpha);
+            state->undo_move(move);
+            if (max_goodness < goodness) {
+                max_goodness = goodness;
+                if (alpha < goodness) {
+                    alpha = goodness;
+                }
+            }
+            if (alpha >= beta) {
+                ++stats.qcuts;
+                break;
+            }
+        }
+        return max_goodness;
+    }
+
+    void generate_moves(const S *state, MoveList<M> &moves) const {
+        if (get_legal_moves == nullptr) {
+            // through the base, so that a game overriding only the vector version still works
+            const State<S, M> *base = state;
+            base->get_legal_moves(moves, MAX_MOVES);
+            return;
+        }
+        for (const auto &move : get_legal_moves(state, MAX_MOVES)) {
+            moves.push_back(move);
+        }
+    }
+
+    // Returns how many moves are already in place, the rest are scored and picked lazily,
+    // as a cut usually happens after the first few moves.
+    int order_moves(MoveList<M> &moves, const M *hash_move) const {
+        int first = 0;
+        if (use_hash_move && hash_move != nullptr) {
+            first = move_to_front(moves, first, *hash_move);
+        }
+        if (use_killers && ply < MAX_PLY) {
+            for (const auto &killer : killers[ply]) {
+                first = move_to_front(moves, first, killer);
+            }
+        }
+        return first;
+    }
+
+    void score_moves(const MoveList<M> &moves, int *scores, int first) const {
+        for (int i = first; i < moves.size(); ++i) {
+            scores[i] = history[get_history_index(moves[i])];
+        }
+    }
+
+    // Returns false once only moves without history are left, they stay in generator order
+    bool pick_move(MoveList<M> &moves, int *scores, int index) const {
+        int best = index;
+        for (int i = index + 1; i < moves.size(); ++i) {
+            // strictly greater, so generator order breaks ties
+            if (scores[best] < scores[i]) {
+                best = i;
+            }
+        }
+        if (scores[best] == 0) {
             return false;
         }
-        entry = it->second;
+        if (best != index) {
+            std::swap(moves[index], moves[best]);
+            std::swap(scores[index], scores[best]);
+        }
         return true;
     }
 
+    // Without a cut after the lazy picks it's likely an all-node, picking on would be quadratic
+    void sort_moves(MoveList<M> &moves, const int *scores, int index) const {
+        int order[MAX_LEGAL_MOVES];
+        const int count = moves.size() - index;
+        for (int i = 0; i < count; ++i) {
+            order[i] = index + i;
+        }
+        // ties by position, like a stable sort, which could allocate
+        std::sort(order, order + count, [scores](int a, int b) {
+            return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+        });
+        MoveList<M> sorted;
+        for (int i = 0; i < count; ++i) {
+            sorted.push_back(moves[order[i]]);
+        }
+        for (int i = 0; i < count; ++i) {
+            moves[index + i] = sorted[i];
+        }
+    }
+
+    int move_to_front(MoveList<M> &moves, int first, const M &move) const {
+        const auto it = find(moves.begin() + first, moves.end(), move);
+        if (it == moves.end()) {
+            return first;
+        }
+        std::rotate(moves.begin() + first, it, it + 1);
+        return first + 1;
+    }
+
+    void add_killer(const M &move) {
+        if (ply >= MAX_PLY) {
+            return;
+        }
+        auto &ply_killers = killers[ply];
+        if (!ply_killers.empty() && ply_killers[0] == move) {
+            return;
+        }
+        ply_killers.insert(ply_killers.begin(), move);
+        if (ply_killers.size() > KILLERS) {
+            ply_killers.pop_back();
+        }
+    }
+
+    int get_history_index(const M &move) const {
+        return move.hash() & (HISTORY_SIZE - 1);
+    }
+
+    bool get_tt_entry(const S *state, TTEntry<M> &entry) const {
+        return transposition_table->get(state->hash(), entry);
+    }
+
     void add_tt_entry(const S *state, const TTEntry<M> &entry) {
-        const auto key = state->hash();
-        transposition_table.insert({key, entry});
+        const auto result = transposition_table->put(state->hash(), entry);
+        if (result == REPLACED) {
+            ++stats.tt_replaced;
+        } else if (result == REJECTED) {
+            ++stats.tt_rejected;
+        }
     }
 
     void update_tt(const S *state, int alpha, int beta, int max_goodness, const M &best_move, int depth) {
@@ -584,27 +1893,287 @@ struct Minimax : public Algorithm<S, M> {
         add_tt_entry(state, entry);
     }
 
+    int get_score() const override {
+        return total_stats.goodness;
+    }
+
     string get_name() const {
         return "Minimax";
     }
 };
 
+static const uint32_t NO_NODE = 0xffffffff;
+static const int MCTS_CHUNK_BITS = 16;
+static const int MCTS_MAX_CHUNKS = 1 << 12;
+
+// Adds to an atomic double, which has no fetch_add
+inline void atomic_add(std::atomic<double> &value, double delta) {
+    double old = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(old, old + delta, std::memory_order_relaxed)) {}
+}
+
+// MCTS tree node, apart from the game state: the state of a node is the root state
+// after the moves on the path to it, which the search replays on a clone.
+// Children form a list through next_sibling, the last one added first.
+// Search threads share the nodes: the statistics are atomic, a thread expanding a node holds its busy flag,
+// and publishes the child through first_child and children only when the child is complete.
+template<class M>
+struct MCTSNode {
+    std::atomic<double> score; // from the point of view of player_to_move
+    std::atomic<unsigned> visits;
+    uint32_t parent;
+    std::atomic<uint32_t> first_child;
+    uint32_t next_sibling;
+    typename MoveStorage<M>::type move; // the move that led here
+    std::atomic<uint16_t> children;
+    uint16_t move_count; // legal moves, set before the first child is published
+    uint8_t player_to_move;
+    std::atomic<bool> busy;
+
+    M get_move() const {
+        return MoveStorage<M>::unpack(move);
+    }
+
+    double get_uct(int player, unsigned parent_visits) const {
+        const double visits = this->visits.load(std::memory_order_relaxed);
+        const double score = this->score.load(std::memory_order_relaxed);
+        assert(visits > 0);
+        double ratio = score / visits;
+        if (player != player_to_move) {
+            ratio = (visits - score) / visits;
+        }
+        return ratio + UCT_C * sqrt(log(parent_visits) / visits);
+    }
+
+    bool is_expanded() const {
+        const uint16_t count = children.load(std::memory_order_acquire);
+        return count > 0 && count == move_count;
+    }
+
+    void lock() {
+        while (busy.exchange(true, std::memory_order_acquire)) {}
+    }
+
+    void unlock() {
+        busy.store(false, std::memory_order_release);
+    }
+};
+
+// Nodes are allocated one after another from chunks and refer to each other by index.
+// A chunk is never moved, so search threads read nodes while others add them, and it is kept
+// when the tree is freed, which is O(1). Adding a node doesn't allocate but for a new chunk.
+// Re-rooting frees the nodes outside the new root's subtree to a free list, linked through next_sibling,
+// which add_node takes from first. Only add_node may run concurrently with the search.
+template<class M>
+struct MCTSTree {
+    static const uint32_t CHUNK_SIZE = 1 << MCTS_CHUNK_BITS;
+
+    vector<unique_ptr<MCTSNode<M>[]>> chunks;
+    int chunk_count = 0;
+    uint32_t used = 0;
+    uint32_t root = NO_NODE;
+    uint32_t free_list = NO_NODE;
+    size_t free_count = 0;
+    std::atomic<bool> busy;
+    vector<uint32_t> stack;
+
+    MCTSTree() : chunks(MCTS_MAX_CHUNKS), busy(false) {}
+
+    MCTSTree(const MCTSTree &) = delete;
+
+    MCTSTree &operator=(const MCTSTree &) = delete;
+
+    MCTSNode<M> &operator[](uint32_t index) {
+        return chunks[index >> MCTS_CHUNK_BITS][index & (CHUNK_SIZE - 1)];
+    }
+
+    const MCTSNode<M> &operator[](uint32_t index) const {
+        return chunks[index >> MCTS_CHUNK_BITS][index & (CHUNK_SIZE - 1)];
+    }
+
+    // An unused node, NO_NODE when all the chunks are full
+    uint32_t allocate() {
+        while (busy.exchange(true, std::memory_order_acquire)) {}
+        uint32_t index = free_list;
+        if (index != NO_NODE) {
+            free_list = (*this)[index].next_sibling;
+            --free_count;
+        } else if (used < (uint32_t) chunk_count * CHUNK_SIZE) {
+            index = used++;
+        } else if (chunk_count < MCTS_MAX_CHUNKS) {
+            chunks[chunk_count++].reset(new MCTSNode<M>[CHUNK_SIZE]);
+            index = used++;
+        }
+        busy.store(false, std::memory_order_release);
+        return index;
+    }
+
+    // Fills in an allocated node and links it to the parent, whose lock the caller holds
+    void add_node(uint32_t index, uint32_t parent, const M &move, int player_to_move) {
+        MCTSNode<M> &node = (*this)[index];
+        node.score.store(0, std::memory_order_relaxed);
+        node.visits.store(VIRTUAL_VISITS, std::memory_order_relaxed);
+        node.parent = parent;
+        node.first_child.store(NO_NODE, std::memory_order_relaxed);
+        node.next_sibling = NO_NODE;
+        node.move = MoveStorage<M>::pack(move);
+        node.children.store(0, std::memory_order_relaxed);
+        node.move_count = 0;
+        node.player_to_move = player_to_move;
+        node.busy.store(false, std::memory_order_relaxed);
+        if (parent != NO_NODE) {
+            MCTSNode<M> &parent_node = (*this)[parent];
+            node.next_sibling = parent_node.first_child.load(std::memory_order_relaxed);
+            parent_node.first_child.store(index, std::memory_order_release);
+            parent_node.children.store(parent_node.children.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
+
+    void reset(int player_to_move) {
+        clear();
+        root = allocate();
+        add_node(root, NO_NODE, M(), player_to_move);
+    }
+
+    void clear() {
+        used = 0;
+        root = NO_NODE;
+        free_list = NO_NODE;
+        free_count = 0;
+    }
+
+    // Makes a node of the tree the root, its subtree stays in place. Returns how many nodes were freed.
+    size_t reroot(uint32_t new_root) {
+        const size_t freed = free_count;
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const uint32_t index = stack.back();
+            stack.pop_back();
+            if (index == new_root) {
+                continue;
+            }
+            for (uint32_t child = (*this)[index].first_child; child != NO_NODE; child = (*this)[child].next_sibling) {
+                stack.push_back(child);
+            }
+            (*this)[index].next_sibling = free_list;
+            free_list = index;
+            ++free_count;
+        }
+        root = new_root;
+        (*this)[root].parent = NO_NODE;
+        (*this)[root].next_sibling = NO_NODE;
+        return free_count - freed;
+    }
+
+    uint32_t get_child(uint32_t parent, const M &move) const {
+        const auto key = MoveStorage<M>::pack(move);
+        for (uint32_t child = (*this)[parent].first_child; child != NO_NODE; child = (*this)[child].next_sibling) {
+            if ((*this)[child].move == key) {
+                return child;
+            }
+        }
+        return NO_NODE;
+    }
+
+    size_t size() const {
+        return used - free_count;
+    }
+
+    size_t capacity() const {
+        return (size_t) chunk_count * CHUNK_SIZE;
+    }
+};
+
+// A forked search process and the read end of its pipe
+struct ProcessWorker {
+    pid_t pid;
+    int fd;
+};
+
+// Visits and score of a root child, sent from a worker process
+template<class M>
+struct RootStats {
+    typename MoveStorage<M>::type move;
+    unsigned visits;
+    double score;
+};
+
+inline bool write_fully(int fd, const void *data, size_t size) {
+    const char *bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+inline bool read_fully(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t count = read(fd, bytes, size);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
 template<class S, class M>
 struct MonteCarloTreeSearch : public Algorithm<S, M> {
     const double max_seconds;
     const int max_simulations;
     const int verbose;
+    // Tree parallelism: helper threads run simulations on the shared tree,
+    // virtual loss makes them choose different paths
+    const int threads;
     mutable Random random;
     mutable int policy_moves;
     mutable int rollout_moves;
+    int simulations = 0;
+    vector<int> helper_simulations;
+    // Nodes of the current simulation from the root, for the backup
+    vector<uint32_t> path;
+    // Root parallelism over forked processes, see fork_processes. Combines with threads,
+    // but other threads of the program that could hold locks when get_move forks are the caller's concern.
+    int processes = 1;
+    int score = 0; // per mille of the simulations won
+    // Rollouts end at positions State::get_solved_goodness decides
+    bool use_solver = true;
+    // The tree is kept between moves: the next get_move continues from the node of its state,
+    // usually two plies down, our move and the reply. Pondering does it regardless.
+    bool reuse_tree = true;
+    shared_ptr<MCTSTree<M>> tree;
+    // The state of the root, each simulation replays the moves of its path on a clone
+    shared_ptr<S> root_state;
+    // Stops the helper threads and the ponder thread
+    shared_ptr<std::atomic<bool>> stopped;
+    // Pondering grows the tree after our move, on a hit the node of the actual reply becomes the root
+    shared_ptr<std::thread> ponder_thread;
 
     MonteCarloTreeSearch(double max_seconds = 1,
                          int max_simulations = MAX_SIMULATIONS,
-                         int verbose = 1) :
+                         int verbose = 1,
+                         int threads = 1) :
         Algorithm<S, M>(),
         max_seconds(max_seconds),
         max_simulations(max_simulations),
-        verbose(verbose) {}
+        verbose(verbose),
+        threads(threads),
+        tree(make_shared<MCTSTree<M>>()),
+        stopped(make_shared<std::atomic<bool>>(false)) {
+        path.reserve(MAX_PLY);
+    }
+
+    virtual ~MonteCarloTreeSearch() {
+        stop_ponder();
+    }
 
     M get_move(const S *root) override {
         if (root->is_terminal()) {
@@ -612,131 +2181,883 @@ struct MonteCarloTreeSearch : public Algorithm<S, M> {
             root->to_stream(stream);
             throw invalid_argument("Given state is terminal:\n" + stream.str());
         }
-        Timer timer;
-        timer.start();
-        S clone = root->clone();
-        policy_moves = 0;
-        rollout_moves = 0;
-        while (clone.visits < max_simulations && !timer.exceeded(max_seconds)) {
-            monte_carlo_tree_search(&clone);
+        SearchClock timer;
+        timer.start(max_seconds);
+        const bool pondered = ponder_thread != nullptr;
+        stop_ponder();
+        const bool reused = (reuse_tree || pondered) && use_subtree(root);
+        if (pondered) {
+            this->log << "ponder: " << (reused ? "hit" : "miss") << endl;
+        }
+        if (!reused) {
+            set_root(root);
         }
-        this->log << "ratio: " << clone.score / clone.visits << endl;
-        this->log << "simulations: " << clone.visits << endl;
+        MCTSTree<M> &tree = *this->tree;
+        const unsigned inherited = tree[tree.root].visits - VIRTUAL_VISITS;
+        this->log << "inherited visits: " << inherited << endl;
+
+        vector<ProcessWorker> processes = fork_processes(root, timer);
+        search(timer);
+        const double seconds = timer.seconds_elapsed();
+
+        const MCTSNode<M> &node = tree[tree.root];
+        const unsigned visits = node.visits;
+        const double ratio = node.score / visits;
+        score = 1000 * ratio;
+        this->log << "ratio: " << ratio << endl;
+        this->log << "simulations: " << visits << endl;
+        if (threads > 1) {
+            this->log << "threads: " << threads << " simulations per thread: " << simulations;
+            for (const auto simulations : helper_simulations) {
+                this->log << " " << simulations;
+            }
+            this->log << endl;
+        }
+        this->log << "simulations per second: " << (long long) ((visits - VIRTUAL_VISITS - inherited) / seconds) << endl;
         this->log << "policy moves: " << policy_moves << endl;
         this->log << "rollout moves: " << rollout_moves << endl;
-        const auto legal_moves = clone.get_legal_moves();
+        this->log << "tree nodes: " << tree.size() << " bytes: " << tree.size() * sizeof(MCTSNode<M>) << endl;
+        this->log << "clock checks: " << timer.checks << " overhead: " << (int) (1e6 * timer.get_overhead()) << "us" << endl;
+        const auto legal_moves = root_state->get_legal_moves();
         this->log << "moves: " << legal_moves.size() << endl;
         if (verbose >= 2) {
             for (const auto move : legal_moves) {
                 this->log << "move: " << move;
-                const auto child = clone.get_child(move);
-                if (child != nullptr) {
-                    this->log << " score: " << child->score
-                              << " visits: " << child->visits
-                              << " UCT: " << child->get_uct(UCT_C);
+                const auto child = tree.get_child(tree.root, move);
+                if (child != NO_NODE) {
+                    this->log << " score: " << tree[child].score.load()
+                              << " visits: " << tree[child].visits.load()
+                              << " UCT: " << tree[child].get_uct(node.player_to_move, visits);
                 }
                 this->log << endl;
             }
         }
-        return get_most_visited_move(&clone);
+        if (!processes.empty()) {
+            return merge_processes(processes, timer);
+        }
+        return get_most_visited_move(tree.root);
+    }
+
+    // Runs simulations on this thread and the helper threads until the clock or max_simulations stops them
+    void search(SearchClock &timer) {
+        MCTSTree<M> &tree = *this->tree;
+        policy_moves = 0;
+        rollout_moves = 0;
+        simulations = 0;
+        helper_simulations.clear();
+        *stopped = false;
+        vector<MonteCarloTreeSearch> helpers;
+        helpers.reserve(threads);
+        vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            helpers.push_back(*this);
+            helpers.back().random.engine.seed(random.engine() + i);
+            workers.emplace_back(&MonteCarloTreeSearch::helper_search, &helpers.back());
+        }
+        while (tree[tree.root].visits < max_simulations && !timer.exceeded()) {
+            monte_carlo_tree_search(root_state.get());
+            ++simulations;
+        }
+        *stopped = true;
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        for (const auto &helper : helpers) {
+            helper_simulations.push_back(helper.simulations);
+            policy_moves += helper.policy_moves;
+            rollout_moves += helper.rollout_moves;
+        }
+    }
+
+    // Root parallelism: forked processes search trees of their own from the root, with other seeds,
+    // and send back the statistics of the root and its children, which get_move adds up.
+    // Only the forking thread lives on in a child, so a lock another of our threads held would stay
+    // locked there: the ponder thread is stopped first, and search starts its threads after the fork
+    // and joins them before returning. A child with threads > 1 starts its own. All see the same clock.
+    vector<ProcessWorker> fork_processes(const S *root, SearchClock &timer) {
+        stop_ponder();
+        vector<ProcessWorker> workers;
+        for (int i = 1; i < processes; ++i) {
+            int fds[2];
+            if (pipe(fds) == -1) {
+                break;
+            }
+            const pid_t pid = fork();
+            if (pid == -1) {
+                close(fds[0]);
+                close(fds[1]);
+                break;
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                bool written = false;
+                try {
+                    for (const auto &worker : workers) {
+                        close(worker.fd);
+                    }
+                    random.engine.seed(SEED + 1000 * i);
+                    set_root(root);
+                    search(timer);
+                    written = write_root_stats(fds[1]);
+                } catch (...) {}
+                _exit(written ? 0 : 1);
+            }
+            close(fds[1]);
+            workers.push_back({pid, fds[0]});
+        }
+        return workers;
+    }
+
+    // The root first, then its children
+    bool write_root_stats(int fd) const {
+        const MCTSTree<M> &tree = *this->tree;
+        vector<RootStats<M>> records;
+        records.push_back({tree[tree.root].move, tree[tree.root].visits, tree[tree.root].score});
+        for (uint32_t child = tree[tree.root].first_child; child != NO_NODE; child = tree[child].next_sibling) {
+            records.push_back({tree[child].move, tree[child].visits, tree[child].score});
+        }
+        const uint32_t count = records.size();
+        return write_fully(fd, &count, sizeof(count)) &&
+               write_fully(fd, records.data(), count * sizeof(RootStats<M>));
+    }
+
+    // Adds the visits and scores of the root children over the processes, returns the most visited move.
+    // The log tells apart waiting for the processes to finish and merging what they sent.
+    M merge_processes(const vector<ProcessWorker> &workers, SearchClock &timer) {
+        const MCTSTree<M> &tree = *this->tree;
+        const double start = timer.seconds_elapsed();
+        vector<vector<RootStats<M>>> results(workers.size());
+        for (int i = 0; i < workers.size(); ++i) {
+            uint32_t count = 0;
+            if (read_fully(workers[i].fd, &count, sizeof(count)) && count > 0) {
+                results[i].resize(count);
+                if (!read_fully(workers[i].fd, results[i].data(), count * sizeof(RootStats<M>))) {
+                    results[i].clear();
+                }
+            }
+            close(workers[i].fd);
+            waitpid(workers[i].pid, nullptr, 0);
+        }
+        const double received = timer.seconds_elapsed();
+
+        unordered_map<size_t, RootStats<M>> merged;
+        for (uint32_t child = tree[tree.root].first_child; child != NO_NODE; child = tree[child].next_sibling) {
+            merged[MoveStorage<M>::get_key(tree[child].get_move())] = {tree[child].move, tree[child].visits, tree[child].score};
+        }
+        unsigned visits = tree[tree.root].visits;
+        double score = tree[tree.root].score;
+        for (int i = 0; i < results.size(); ++i) {
+            const auto &records = results[i];
+            if (records.empty()) {
+                this->log << "process " << i + 1 << " failed" << endl;
+                continue;
+            }
+            this->log << "process " << i + 1 << " simulations: " << records[0].visits - VIRTUAL_VISITS << endl;
+            visits += records[0].visits - VIRTUAL_VISITS;
+            score += records[0].score;
+            for (int j = 1; j < records.size(); ++j) {
+                const auto key = MoveStorage<M>::get_key(MoveStorage<M>::unpack(records[j].move));
+                const auto it = merged.find(key);
+                if (it == merged.end()) {
+                    merged[key] = records[j];
+                } else {
+                    it->second.visits += records[j].visits;
+                    it->second.score += records[j].score;
+                }
+            }
+        }
+        const RootStats<M> *best = nullptr;
+        for (const auto &pair : merged) {
+            if (best == nullptr || best->visits < pair.second.visits) {
+                best = &pair.second;
+            }
+        }
+        assert(best != nullptr);
+        this->score = 1000 * score / visits;
+        this->log << "processes: " << workers.size() + 1 << " simulations: " << visits
+                  << " wait: " << (int) (1e6 * (received - start)) << "us"
+                  << " merge: " << (int) (1e6 * (timer.seconds_elapsed() - received)) << "us" << endl;
+        return MoveStorage<M>::unpack(best->move);
+    }
+
+    // Simulations until the root has max_simulations visits or stopped is set
+    void helper_search() {
+        const MCTSTree<M> &tree = *this->tree;
+        while (tree[tree.root].visits < max_simulations && !stopped->load(std::memory_order_relaxed)) {
+            monte_carlo_tree_search(root_state.get());
+            ++simulations;
+        }
+    }
+
+    // Tester calls it before every move, with reuse_tree the subtree of the next position is kept
+    void reset() override {
+        if (!reuse_tree) {
+            clear();
+        }
+    }
+
+    void clear() {
+        stop_ponder();
+        tree->clear();
+        root_state = nullptr;
     }
 
-    void monte_carlo_tree_search(S *root) const {
-        S *current = tree_policy(root, root);
-        S clone = current->clone();
-        const auto result = rollout(&clone, clone.player_to_move);
-        propagate_up(current, result);
+    // A new tree for the state, the memory of the old one is reused
+    void set_root(const S *state) {
+        root_state = make_shared<S>(state->clone());
+        tree->reset(state->player_to_move);
+    }
+
+    // Makes the node of the state the root, returns false if the tree doesn't have it
+    bool use_subtree(const S *state) {
+        const uint32_t node = find_node(state);
+        if (node == NO_NODE) {
+            return false;
+        }
+        const size_t freed = tree->reroot(node);
+        root_state = make_shared<S>(state->clone());
+        this->log << "freed nodes: " << freed << endl;
+        return true;
     }
 
-    void propagate_up(S *current, double result) const {
-        current->score += result;
-        ++current->visits;
-        if (current->parent) {
-            propagate_up(current->parent, 1 - result);
+    // Looks for the state at the root and at most two plies below it, NO_NODE if it isn't there
+    uint32_t find_node(const S *state) const {
+        const MCTSTree<M> &tree = *this->tree;
+        if (tree.root == NO_NODE) {
+            return NO_NODE;
+        }
+        if (*root_state == *state) {
+            return tree.root;
+        }
+        const size_t hash = state->hash();
+        for (uint32_t child = tree[tree.root].first_child; child != NO_NODE; child = tree[child].next_sibling) {
+            S child_state = root_state->clone();
+            child_state.make_move(tree[child].get_move());
+            if (child_state.hash() == hash && child_state == *state) {
+                return child;
+            }
+            for (uint32_t grandchild = tree[child].first_child; grandchild != NO_NODE; grandchild = tree[grandchild].next_sibling) {
+                const M move = tree[grandchild].get_move();
+                child_state.make_move(move);
+                const bool found = child_state.hash() == hash && child_state == *state;
+                child_state.undo_move(move);
+                if (found) {
+                    return grandchild;
+                }
+            }
         }
+        return NO_NODE;
     }
 
-    S* tree_policy(S *state, const S *root) const {
+    void start_ponder(const S *state) override {
+        stop_ponder();
         if (state->is_terminal()) {
-            return state;
+            return;
         }
-        ++policy_moves;
-        const M move = get_best_move(state);
-        const auto child = state->get_child(move);
-        if (child == nullptr) {
-            return state->add_child(move);
+        if (!use_subtree(state)) {
+            set_root(state);
         }
-        return tree_policy(child, root);
+        *stopped = false;
+        ponder_thread = make_shared<std::thread>(&MonteCarloTreeSearch::helper_search, this);
     }
 
-    M get_most_visited_move(const S *state) const {
-        const auto legal_moves = state->get_legal_moves();
-        assert(!legal_moves.empty());
-        M best_move;
-        double max_visits = -INF;
-        for (const auto move : legal_moves) {
-            const auto child = state->get_child(move);
-            if (child != nullptr) {
-                const auto visits = child->visits;
-                if (max_visits < visits) {
-                    max_visits = visits;
-                    best_move = move;
+    void stop_ponder() override {
+        if (ponder_thread == nullptr) {
+            return;
+        }
+        *stopped = true;
+        ponder_thread->join();
+        ponder_thread = nullptr;
+        this->log << "ponder simulations: " << (*tree)[tree->root].visits << endl;
+    }
+
+    // Plays one simulation on a clone of the root state: the moves of the path are replayed on it,
+    // then the rollout plays on from there, nothing is undone.
+    // Nodes on the path get their visit at once, with a win for the player to move there (virtual loss),
+    // so that other threads see the path as worse for whoever chooses it until the result comes back.
+    void monte_carlo_tree_search(const S *root) {
+        S state = root->clone();
+        tree_policy(&state);
+        propagate_up(rollout(&state, state.player_to_move));
+    }
+
+    void add_virtual_loss(uint32_t node) {
+        (*tree)[node].visits.fetch_add(1, std::memory_order_relaxed);
+        atomic_add((*tree)[node].score, WIN_SCORE);
+        path.push_back(node);
+    }
+
+    // Replaces the virtual losses on the path with the result, from the leaf up, the visits are already counted
+    void propagate_up(double result) {
+        MCTSTree<M> &tree = *this->tree;
+        for (int i = path.size() - 1; i >= 0; --i) {
+            atomic_add(tree[path[i]].score, result - WIN_SCORE);
+            result = 1 - result;
+        }
+    }
+
+    // Descends from the root making the moves on the state and recording the nodes in path.
+    // Returns the node it ended in, a terminal one or a new child (or a leaf, when the tree is full).
+    uint32_t tree_policy(S *state) {
+        MCTSTree<M> &tree = *this->tree;
+        path.clear();
+        uint32_t node = tree.root;
+        add_virtual_loss(node);
+        while (!state->is_terminal()) {
+            ++policy_moves;
+            if (!tree[node].is_expanded()) {
+                MoveList<M> legal_moves;
+                generate_moves(state, legal_moves);
+                assert(!legal_moves.empty());
+                tree[node].lock();
+                // another thread could have added the last child meanwhile
+                const uint16_t children = tree[node].children.load(std::memory_order_relaxed);
+                if (children < legal_moves.size()) {
+                    if (children == 0) {
+                        tree[node].move_count = legal_moves.size();
+                    }
+                    const uint32_t child = tree.allocate();
+                    if (child != NO_NODE) {
+                        // expanded in the order of generation, so the next move is the first without a child
+                        const M move = legal_moves[children];
+                        state->make_move(move);
+                        tree.add_node(child, node, move, state->player_to_move);
+                        add_virtual_loss(child);
+                    }
+                    tree[node].unlock();
+                    return path.back();
                 }
+                tree[node].unlock();
             }
+            node = get_best_child(node);
+            add_virtual_loss(node);
+            state->make_move(tree[node].get_move());
         }
-        assert(max_visits != -INF);
-        return best_move;
+        return node;
     }
 
-    M get_best_move(S *state) const {
-        const auto legal_moves = state->get_legal_moves();
-        assert(!legal_moves.empty());
-        M best_move;
+    // The children are listed from the last generated move, <= keeps the first of equal ones
+    M get_most_visited_move(uint32_t node) const {
+        const MCTSTree<M> &tree = *this->tree;
+        uint32_t best_child = NO_NODE;
+        double max_visits = -INF;
+        for (uint32_t child = tree[node].first_child; child != NO_NODE; child = tree[child].next_sibling) {
+            if (max_visits <= tree[child].visits) {
+                max_visits = tree[child].visits;
+                best_child = child;
+            }
+        }
+        assert(best_child != NO_NODE);
+        return tree[best_child].get_move();
+    }
+
+    uint32_t get_best_child(uint32_t node) const {
+        const MCTSTree<M> &tree = *this->tree;
+        const int player = tree[node].player_to_move;
+        const unsigned visits = tree[node].visits;
+        uint32_t best_child = NO_NODE;
         double best_uct = -INF;
-        for (const auto move : legal_moves) {
-            const auto child = state->get_child(move);
-            if (child != nullptr) {
-                const auto uct = child->get_uct(state->player_to_move);
-                if (best_uct < uct) {
-                    best_uct = uct;
-                    best_move = move;
-                }
-            } else {
-                return move;
+        for (uint32_t child = tree[node].first_child.load(std::memory_order_acquire); child != NO_NODE; child = tree[child].next_sibling) {
+            const auto uct = tree[child].get_uct(player, visits);
+            if (best_uct <= uct) {
+                best_uct = uct;
+                best_child = child;
             }
         }
-        return best_move;
+        return best_child;
     }
 
     M get_random_move(const S *state) const {
-        const auto legal_moves = state->get_legal_moves();
+        MoveList<M> legal_moves;
+        generate_moves(state, legal_moves);
         assert(!legal_moves.empty());
         const int index = random.uniform(0, legal_moves.size() - 1);
         return legal_moves[index];
     }
 
+    void generate_moves(const S *state, MoveList<M> &moves) const {
+        const State<S, M> *base = state;
+        base->get_legal_moves(moves, INF);
+    }
+
+    // Plays random moves on the state until the result is known and leaves it there
     double rollout(S *current, const int rollout_player) const {
-        if (current->is_terminal()) {
-            if (current->is_winner(rollout_player)) {
-                return WIN_SCORE;
+        int solved_goodness;
+        while (!current->is_terminal()) {
+            if (use_solver && current->get_solved_goodness(solved_goodness)) {
+                if (solved_goodness == 0) {
+                    return DRAW_SCORE;
+                }
+                return (solved_goodness > 0) == current->is_team_mate(rollout_player) ? WIN_SCORE : LOSE_SCORE;
             }
-            if (current->is_winner(current->get_next_player(rollout_player))) {
-                return LOSE_SCORE;
+            ++rollout_moves;
+            current->make_move(get_random_move(current));
+        }
+        if (current->is_winner(rollout_player)) {
+            return WIN_SCORE;
+        }
+        if (current->is_winner(current->get_next_player(rollout_player))) {
+            return LOSE_SCORE;
+        }
+        return DRAW_SCORE;
+    }
+
+    int get_score() const override {
+        return score;
+    }
+
+    string get_name() const {
+        return "MCTS";
+    }
+
+};
+
+// Proof and disproof numbers: how many leaves still have to be won (lost) to prove (disprove) a node
+static const uint32_t PROOF_INF = 0xffffffff;
+
+struct ProofEntry {
+    uint32_t proof;
+    uint32_t disproof;
+    int16_t depth; // log2 of the nodes spent below, so that the table keeps the costly entries
+
+    ProofEntry() {}
+
+    ProofEntry(uint32_t proof, uint32_t disproof, int16_t depth = 0) :
+            proof(proof), disproof(disproof), depth(depth) {}
+};
+
+enum ProofResult { PROVEN_WIN, PROVEN_LOSS, PROVEN_DRAW, UNKNOWN };
+
+inline ostream &operator<<(ostream &os, ProofResult result) {
+    static const char *names[] = {"win", "loss", "draw", "unknown"};
+    return os << names[result];
+}
+
+// Depth first proof number search (df-pn), solves positions instead of evaluating them.
+// Proves whether the player to move can force a win, if not, whether the opponents can,
+// using only is_terminal and is_winner. The numbers live in a fixed size table, so memory is bounded.
+// Assumes the game graph has no cycles.
+template<class S, class M>
+struct ProofNumberSearch : public Algorithm<S, M> {
+    const double MAX_SECONDS;
+    const int verbose;
+    shared_ptr<TranspositionTable<M, ProofEntry>> proof_table;
+    SearchClock timer;
+    int attacker = 0;
+    // Of the last get_move, the move proves the result when it's a win
+    ProofResult result = UNKNOWN;
+    M proving_move;
+    long long nodes = 0;
+
+    ProofNumberSearch(double max_seconds = 1, int tt_megabytes = TT_MEGABYTES, int verbose = 1) :
+            Algorithm<S, M>(),
+            MAX_SECONDS(max_seconds),
+            verbose(verbose),
+            // a rejected store would leave the parent with stale numbers, searching the same child forever
+            proof_table(make_shared<TranspositionTable<M, ProofEntry>>(tt_megabytes, ALWAYS_REPLACE)) {}
+
+    void reset() override {
+        proof_table->clear();
+    }
+
+    M get_move(const S *root) override {
+        if (root->is_terminal()) {
+            stringstream stream;
+            root->to_stream(stream);
+            throw invalid_argument("Given state is terminal:\n" + stream.str());
+        }
+        timer.start(MAX_SECONDS);
+        proof_table->new_search();
+        nodes = 0;
+        S state = root->clone();
+        const int player = state.player_to_move;
+        const int enemy = state.get_next_enemy(player);
+        result = UNKNOWN;
+        ProofEntry entry = prove(&state, player);
+        if (entry.proof == 0) {
+            result = PROVEN_WIN;
+        } else if (entry.disproof == 0) {
+            // we can't win, do they?
+            entry = prove(&state, enemy);
+            if (entry.proof == 0) {
+                result = PROVEN_LOSS;
+            } else if (entry.disproof == 0 && state.teams[state.get_next_enemy(enemy)] == state.teams[player]) {
+                result = PROVEN_DRAW;
             }
-            return DRAW_SCORE;
         }
-        ++rollout_moves;
-        M move = get_random_move(current);
-        current->make_move(move);
-        auto result = rollout(current, rollout_player);
-        current->undo_move(move);
+        proving_move = get_best_move(&state, attacker);
+        this->log << "result: " << result << endl;
+        this->log << "move: " << proving_move << endl;
+        this->log << "nodes: " << nodes << endl;
+        this->log << "time: " << timer << endl;
+        if (verbose >= 2) {
+            this->log << "tt size: " << proof_table->size() << " fill: " << proof_table->get_fill_rate() << endl;
+            this->log << "clock checks: " << timer.checks << " overhead: " << (int) (1e6 * timer.get_overhead()) << "us" << endl;
+        }
+        return proving_move;
+    }
+
+    // Searches until the root is proven, disproven or the time is up
+    ProofEntry prove(S *state, int player) {
+        attacker = player;
+        return search(state, PROOF_INF, PROOF_INF);
+    }
+
+    // Expands the most proving node below until the numbers reach the thresholds, returns them
+    ProofEntry search(S *state, uint32_t max_proof, uint32_t max_disproof) {
+        ++nodes;
+        const long long start_nodes = nodes;
+        ProofEntry entry = get_entry(state);
+        if (entry.proof >= max_proof || entry.disproof >= max_disproof) {
+            return entry;
+        }
+        const int16_t depth = entry.depth;
+        const bool attacking = state->is_team_mate(attacker);
+        MoveList<M> moves;
+        generate_moves(state, moves);
+        while (true) {
+            // attacker picks the child with the smallest proof number, defender with the smallest disproof
+            uint32_t proof_sum = 0, disproof_sum = 0, best = PROOF_INF, second = PROOF_INF;
+            int best_index = 0;
+            ProofEntry best_child(PROOF_INF, PROOF_INF);
+            for (int i = 0; i < moves.size(); ++i) {
+                state->make_move(moves[i]);
+                const ProofEntry child = get_entry(state);
+                state->undo_move(moves[i]);
+                proof_sum = add_proofs(proof_sum, child.proof);
+                disproof_sum = add_proofs(disproof_sum, child.disproof);
+                const uint32_t number = attacking ? child.proof : child.disproof;
+                if (number < best) {
+                    second = best;
+                    best = number;
+                    best_index = i;
+                    best_child = child;
+                } else if (number < second) {
+                    second = number;
+                }
+            }
+            if (attacking) {
+                entry = ProofEntry(best, disproof_sum);
+            } else {
+                entry = ProofEntry(proof_sum, best);
+            }
+            if (entry.proof >= max_proof || entry.disproof >= max_disproof || timer.exceeded()) {
+                break;
+            }
+            uint32_t child_max_proof, child_max_disproof;
+            if (attacking) {
+                child_max_proof = std::min<uint64_t>(max_proof, (uint64_t) second + 1);
+                child_max_disproof = get_child_threshold(max_disproof, entry.disproof, best_child.disproof);
+            } else {
+                child_max_proof = get_child_threshold(max_proof, entry.proof, best_child.proof);
+                child_max_disproof = std::min<uint64_t>(max_disproof, (uint64_t) second + 1);
+            }
+            state->make_move(moves[best_index]);
+            search(state, child_max_proof, child_max_disproof);
+            state->undo_move(moves[best_index]);
+        }
+        entry.depth = std::max(depth, get_log2(nodes - start_nodes + 1));
+        proof_table->put(get_key(state), entry);
+        return entry;
+    }
+
+    // Terminal nodes are proven or disproven, unknown ones start at 1
+    ProofEntry get_entry(const S *state) const {
+        if (state->is_terminal()) {
+            if (state->is_winner(attacker)) {
+                return ProofEntry(0, PROOF_INF);
+            }
+            return ProofEntry(PROOF_INF, 0);
+        }
+        ProofEntry entry;
+        if (proof_table->get(get_key(state), entry)) {
+            return entry;
+        }
+        return ProofEntry(1, 1);
+    }
+
+    // The numbers depend on who attacks, so the searches for each team use separate keys
+    uint64_t get_key(const S *state) const {
+        return state->hash() ^ (0x9e3779b97f4a7c15ULL * (state->teams[attacker] + 1));
+    }
+
+    // The child takes the threshold left over by its siblings
+    static uint32_t get_child_threshold(uint32_t max_number, uint32_t number, uint32_t child_number) {
+        if (max_number == PROOF_INF) {
+            return PROOF_INF;
+        }
+        return std::min<uint64_t>(PROOF_INF - 1, (uint64_t) max_number - number + child_number);
+    }
+
+    // Sums saturate below PROOF_INF, which only a lost child gives
+    static uint32_t add_proofs(uint32_t a, uint32_t b) {
+        if (a == PROOF_INF || b == PROOF_INF) {
+            return PROOF_INF;
+        }
+        return std::min<uint64_t>(PROOF_INF - 1, (uint64_t) a + b);
+    }
+
+    static int16_t get_log2(long long n) {
+        int16_t result = 0;
+        while (n > 1) {
+            n >>= 1;
+            ++result;
+        }
         return result;
     }
 
+    // The attacker plays towards the proof, the defender resists the longest:
+    // prefers where the attacker is disproven, then where proving took the most work
+    M get_best_move(S *state, int player) {
+        attacker = player;
+        const bool attacking = state->is_team_mate(attacker);
+        MoveList<M> moves;
+        generate_moves(state, moves);
+        assert(!moves.empty());
+        M best_move = moves[0];
+        ProofEntry best(PROOF_INF, PROOF_INF, -1);
+        for (const auto &move : moves) {
+            state->make_move(move);
+            const ProofEntry child = get_entry(state);
+            state->undo_move(move);
+            bool better;
+            if (attacking) {
+                better = child.proof < best.proof || (child.proof == best.proof && child.depth < best.depth);
+            } else {
+                better = child.disproof < best.disproof || (child.disproof == best.disproof && child.depth > best.depth);
+            }
+            if (better || best.depth == -1) {
+                best = child;
+                best_move = move;
+            }
+        }
+        return best_move;
+    }
+
+    void generate_moves(const S *state, MoveList<M> &moves) const {
+        const State<S, M> *base = state;
+        base->get_legal_moves(moves, INF);
+    }
+
     string get_name() const {
-        return "MCTS";
+        return "ProofNumberSearch";
+    }
+};
+
+// Opening book file: a header, then entries sorted by key, read in place through mmap
+static const char BOOK_MAGIC[8] = {'G', 'T', 'S', 'A', 'B', 'O', 'O', 'K'};
+
+struct BookHeader {
+    char magic[8];
+    uint32_t entry_size;
+    uint32_t reserved;
+    uint64_t count;
+};
+
+template<class M>
+struct BookEntry {
+    uint64_t key;
+    typename MoveStorage<M>::type move;
+    int32_t score;
+
+    M get_move() const {
+        return MoveStorage<M>::unpack(move);
+    }
+
+    bool operator<(const BookEntry &other) const {
+        return key < other.key;
+    }
+};
+
+// Read only view of a book file. Mapping it is the whole startup, nothing is parsed,
+// a lookup is a binary search in the mapped pages. Keys are state hashes, so hash() has to be the same in every run.
+template<class M>
+struct OpeningBook {
+    static_assert(std::is_trivially_copyable<BookEntry<M>>::value, "Book entries are read from the file as they are");
+
+    void *memory = MAP_FAILED;
+    size_t bytes = 0;
+    const BookEntry<M> *entries = nullptr;
+    size_t count = 0;
+
+    OpeningBook(const string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw runtime_error("Can't open book: " + path);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && (size_t) file_stat.st_size >= sizeof(BookHeader)) {
+            bytes = file_stat.st_size;
+            memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw runtime_error("Can't map book: " + path);
+        }
+        const BookHeader *header = static_cast<const BookHeader*>(memory);
+        if (memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0 ||
+            header->entry_size != sizeof(BookEntry<M>) ||
+            header->count > (bytes - sizeof(BookHeader)) / sizeof(BookEntry<M>)) {
+            munmap(memory, bytes);
+            throw runtime_error("Invalid book: " + path);
+        }
+        entries = reinterpret_cast<const BookEntry<M>*>(static_cast<const char*>(memory) + sizeof(BookHeader));
+        count = header->count;
+    }
+
+    OpeningBook(const OpeningBook &) = delete;
+
+    OpeningBook &operator=(const OpeningBook &) = delete;
+
+    virtual ~OpeningBook() {
+        munmap(memory, bytes);
+    }
+
+    bool get(uint64_t key, BookEntry<M> &entry) const {
+        const auto end = entries + count;
+        const auto it = std::lower_bound(entries, end, key, [](const BookEntry<M> &e, uint64_t k) {
+            return e.key < k;
+        });
+        if (it == end || it->key != key) {
+            return false;
+        }
+        entry = *it;
+        return true;
     }
 
+    size_t size() const {
+        return count;
+    }
+};
+
+// Builds a book offline, searching every position of the first plies with the given algorithm.
+// Besides the best move, follows the first max_replies legal moves of each position,
+// so that the book covers the opponent's deviations too.
+template<class S, class M>
+struct BookBuilder {
+    shared_ptr<Algorithm<S, M>> algorithm;
+    const int plies;
+    const int max_replies;
+    const int verbose;
+    vector<BookEntry<M>> entries;
+    unordered_set<uint64_t> visited;
+
+    BookBuilder(const shared_ptr<Algorithm<S, M>> &algorithm, int plies = 2, int max_replies = 4, int verbose = 0) :
+            algorithm(algorithm), plies(plies), max_replies(max_replies), verbose(verbose) {}
+
+    void build(const S &root) {
+        S state = root.clone();
+        add(&state, 0);
+    }
+
+    void add(S *state, int ply) {
+        if (ply >= plies || state->is_terminal() || !visited.insert(state->hash()).second) {
+            return;
+        }
+        const M best_move = algorithm->get_move(state);
+        BookEntry<M> entry = BookEntry<M>();
+        entry.key = state->hash();
+        entry.move = MoveStorage<M>::pack(best_move);
+        entry.score = algorithm->get_score();
+        entries.push_back(entry);
+        const string log = algorithm->read_log();
+        if (verbose >= 1) {
+            cout << "ply: " << ply << " entries: " << entries.size() << " move: " << best_move
+                 << " score: " << entry.score << endl;
+            if (verbose >= 2) {
+                cout << log;
+            }
+        }
+        MoveList<M> moves;
+        const State<S, M> *base = state;
+        base->get_legal_moves(moves, INF);
+        follow(state, best_move, ply);
+        for (int i = 0; i < moves.size() && i < max_replies; ++i) {
+            if (!(moves[i] == best_move)) {
+                follow(state, moves[i], ply);
+            }
+        }
+    }
+
+    void follow(S *state, const M &move, int ply) {
+        state->make_move(move);
+        add(state, ply + 1);
+        state->undo_move(move);
+    }
+
+    void save(const string &path) const {
+        vector<BookEntry<M>> sorted = entries;
+        std::sort(sorted.begin(), sorted.end());
+        BookHeader header = BookHeader();
+        memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+        header.entry_size = sizeof(BookEntry<M>);
+        header.count = sorted.size();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(BookEntry<M>));
+        if (!file) {
+            throw runtime_error("Can't write book: " + path);
+        }
+    }
+};
+
+// Plays from the book, asks the wrapped algorithm about positions the book doesn't have
+template<class S, class M>
+struct BookAlgorithm : public Algorithm<S, M> {
+    shared_ptr<OpeningBook<M>> book;
+    shared_ptr<Algorithm<S, M>> algorithm;
+    int score = 0;
+    int hits = 0;
+    int misses = 0;
+
+    BookAlgorithm(const shared_ptr<OpeningBook<M>> &book, const shared_ptr<Algorithm<S, M>> &algorithm) :
+            Algorithm<S, M>(), book(book), algorithm(algorithm) {}
+
+    M get_move(const S *state) override {
+        BookEntry<M> entry;
+        // a colliding key could give a move of another position
+        if (book->get(state->hash(), entry) && is_legal(state, entry.get_move())) {
+            ++hits;
+            score = entry.score;
+            this->log << "book: hit move: " << entry.get_move() << " score: " << score << endl;
+            return entry.get_move();
+        }
+        ++misses;
+        const M move = algorithm->get_move(state);
+        score = algorithm->get_score();
+        return move;
+    }
+
+    bool is_legal(const S *state, const M &move) const {
+        MoveList<M> moves;
+        const State<S, M> *base = state;
+        base->get_legal_moves(moves, INF);
+        return std::find(moves.begin(), moves.end(), move) != moves.end();
+    }
+
+    string read_log() override {
+        return Algorithm<S, M>::read_log() + algorithm->read_log();
+    }
+
+    int get_score() const override {
+        return score;
+    }
+
+    void reset() override {
+        algorithm->reset();
+    }
+
+    void start_ponder(const S *state) override {
+        algorithm->start_ponder(state);
+    }
+
+    void stop_ponder() override {
+        algorithm->stop_ponder();
+    }
+
+    string get_name() const {
+        return algorithm->get_name() + " with book";
+    }
 };
 
 struct OutcomeCounts {
@@ -753,6 +3074,8 @@ struct Tester {
     const int MATCHES;
     const int VERBOSE;
     const bool SAVE;
+    // Algorithms think on the opponent's time, in one process they compete with it for the CPU
+    const bool PONDER;
     const double P_VALUE = 0.005; // two sided 99% confidence interval
     const double draw_score = 0.5;
 
@@ -760,8 +3083,9 @@ struct Tester {
            const vector<shared_ptr<Algorithm<S, M>>> &algorithms,
            int matches = INF,
            int verbose = 0,
-           bool save = false
-    ) : root(state), algorithms(algorithms), MATCHES(matches), VERBOSE(verbose), SAVE(save) {
+           bool save = false,
+           bool ponder = false
+    ) : root(state), algorithms(algorithms), MATCHES(matches), VERBOSE(verbose), SAVE(save), PONDER(ponder) {
         if (algorithms.size() != state->teams.size()) {
             throw invalid_argument("State requires passing " + to_string(state->teams.size()) + " algorithms");
         }
@@ -805,6 +3129,9 @@ struct Tester {
                     cout << timer << endl;
                 }
                 current.make_move(move);
+                if (PONDER && !current.is_terminal()) {
+                    algorithm_ptr->start_ponder(&current);
+                }
                 ++move_number;
                 if (VERBOSE >= 1) {
                     cout << current << endl;
@@ -814,6 +3141,9 @@ struct Tester {
                 }
                 boost::hash_combine(game_hash, current.hash());
             }
+            for (const auto &algorithm : algorithms) {
+                algorithm->stop_ponder();
+            }
             cout << "Game " << i << endl;
             const auto insert = unique_game_hashes.insert(game_hash);
             if (!insert.second) {
@@ -0,0 +1,53 @@
+#include "../examples/isola.cpp"
+
+static const int ROUNDS = 2000;
+
+// How the state was hashed before incremental hashing, rebuilt from the whole state
+size_t full_hash(const IsolaState &state) {
+    using boost::hash_value;
+    using boost::hash_combine;
+    size_t seed = 0;
+    hash_combine(seed, std::hash<bitset<SIDE * SIDE>>()(state.board.board));
+    hash_combine(seed, hash_value(state.player_cords));
+    hash_combine(seed, hash_value(state.player_to_move));
+    return seed;
+}
+
+template<class F>
+double measure(IsolaState &state, const vector<IsolaMove> &moves, F hash_fn) {
+    size_t checksum = 0;
+    Timer timer;
+    timer.start();
+    for (int i = 0; i < ROUNDS; ++i) {
+        for (const auto &move : moves) {
+            state.make_move(move);
+            checksum += hash_fn(state);
+            state.undo_move(move);
+        }
+    }
+    const double seconds = timer.seconds_elapsed();
+    cout << "checksum: " << checksum << endl;
+    return 1e9 * seconds / (ROUNDS * moves.size());
+}
+
+int main() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    const auto moves = state.get_legal_moves();
+    const double none = measure(state, moves, [](const IsolaState &s) { return 0; });
+    const double full = measure(state, moves, [](const IsolaState &s) { return full_hash(s); });
+    const double scratch = measure(state, moves, [](const IsolaState &s) { return s.compute_zobrist(); });
+    const double incremental = measure(state, moves, [](const IsolaState &s) { return s.hash(); });
+    cout << std::setprecision(1) << std::fixed;
+    cout << "make + hash + undo, ns per node" << endl;
+    cout << "no hash: " << none << endl;
+    cout << "full hash: " << full << endl;
+    cout << "zobrist from scratch: " << scratch << endl;
+    cout << "incremental zobrist: " << incremental << endl;
+    return 0;
+}
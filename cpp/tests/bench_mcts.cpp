@@ -0,0 +1,60 @@
+// Built for Isola, or for Go with -D BENCH_GO, the examples can't share a program
+#ifdef BENCH_GO
+#include "../examples/go.cpp"
+
+typedef GoState S;
+typedef GoMove M;
+
+S get_root() {
+    return GoState("_____"
+                   "_____"
+                   "_____"
+                   "_____"
+                   "_____");
+}
+#else
+#include "../examples/isola.cpp"
+
+typedef IsolaState S;
+typedef IsolaMove M;
+
+S get_root() {
+    return IsolaState("___2___"
+                      "_______"
+                      "_______"
+                      "_______"
+                      "_______"
+                      "_______"
+                      "___1___");
+}
+#endif
+
+static const double SECONDS = 2;
+
+long long get_simulations_per_second(const string &log) {
+    const string prefix = "simulations per second: ";
+    return std::stoll(log.substr(log.find(prefix) + prefix.size()));
+}
+
+// Tree parallel MCTS from the same position for a growing number of threads,
+// the speedup is over one thread, the efficiency is the speedup per thread
+int main() {
+    const S root = get_root();
+    cout << root;
+    const int cores = std::thread::hardware_concurrency();
+    long long single = 0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        MonteCarloTreeSearch<S, M> mcts(SECONDS, MAX_SIMULATIONS, 0, threads);
+        mcts.get_move(&root);
+        const long long per_second = get_simulations_per_second(mcts.read_log());
+        if (threads == 1) {
+            single = per_second;
+        }
+        const double speedup = (double) per_second / single;
+        cout << "threads: " << threads
+             << " simulations per second: " << per_second
+             << " speedup: " << std::setprecision(2) << std::fixed << speedup
+             << " efficiency: " << speedup / threads
+             << (threads > cores ? " (more threads than cores)" : "") << endl;
+    }
+}
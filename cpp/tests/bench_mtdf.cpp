@@ -0,0 +1,67 @@
+#include "../examples/isola.cpp"
+
+static const double SECONDS = 1;
+
+// Both searches get the same time, compares how deep they got and how many nodes that took.
+// Stable is without the goodness noise, so that the passes agree on leaf values.
+void run(const IsolaState &state, bool mtdf, bool stable) {
+    IsolaState root = state.clone();
+    root.noise = !stable;
+    Minimax<IsolaState, IsolaMove> minimax(SECONDS);
+    minimax.use_mtdf = mtdf;
+    minimax.get_move(&root);
+    long long nodes = 0;
+    for (const auto &iteration : minimax.iterations) {
+        nodes += iteration.nodes;
+    }
+    cout << (mtdf ? "MTD(f)   " : "NegaScout") << (stable ? " stable" : " noisy ")
+         << " depth: " << minimax.total_stats.depth
+         << " nodes: " << nodes
+         << " goodness: " << minimax.total_stats.goodness
+         << " passes:";
+    for (const auto &iteration : minimax.iterations) {
+        cout << " " << iteration.passes;
+    }
+    cout << endl;
+}
+
+int main() {
+    const vector<IsolaState> states = {
+        IsolaState("___2___"
+                   "_______"
+                   "_______"
+                   "_______"
+                   "_______"
+                   "_______"
+                   "___1___"),
+        IsolaState("___2___"
+                   "_______"
+                   "__#____"
+                   "_______"
+                   "____#__"
+                   "_______"
+                   "___1___"),
+        IsolaState("_#_#___"
+                   "___2_#_"
+                   "__#____"
+                   "_#_____"
+                   "____#__"
+                   "__1__#_"
+                   "_#_____"),
+        IsolaState("__#____"
+                   "_1#__2_"
+                   "__#____"
+                   "###____"
+                   "#######"
+                   "#######"
+                   "#######"),
+    };
+    for (const auto &state : states) {
+        cout << state;
+        for (bool stable : {true, false}) {
+            for (bool mtdf : {false, true}) {
+                run(state, mtdf, stable);
+            }
+        }
+    }
+}
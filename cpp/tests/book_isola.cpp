@@ -0,0 +1,33 @@
+#include "../examples/isola.cpp"
+
+static const int PLIES = 3;
+static const int MAX_REPLIES = 8;
+
+int main(int argc, char **argv) {
+    const string path = argc > 1 ? argv[1] : "isola.book";
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+
+    auto algorithm = shared_ptr<Algorithm<IsolaState, IsolaMove>>(new Minimax<IsolaState, IsolaMove>(1));
+    BookBuilder<IsolaState, IsolaMove> builder(algorithm, PLIES, MAX_REPLIES, 1);
+    builder.build(state);
+    builder.save(path);
+    cout << "saved " << builder.entries.size() << " positions to " << path << endl;
+
+    OpeningBook<IsolaMove> book(path);
+    BookEntry<IsolaMove> entry;
+    Timer timer;
+    timer.start();
+    const int LOOKUPS = 1000000;
+    int found = 0;
+    for (int i = 0; i < LOOKUPS; ++i) {
+        found += book.get(builder.entries[i % builder.entries.size()].key, entry);
+    }
+    cout << "lookup: " << 1e9 * timer.seconds_elapsed() / LOOKUPS << "ns found: " << found << endl;
+    return 0;
+}
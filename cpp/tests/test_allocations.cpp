@@ -0,0 +1,103 @@
+#include <assert.h>
+#include <cstdlib>
+#include <new>
+
+#include "../examples/isola.cpp"
+
+static long allocations = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+template<class S, class M>
+long count_minimax_allocations(S &state, int depth) {
+    Minimax<S, M> minimax(INF, INF, nullptr, nullptr, 0);
+    minimax.get_goodness = &State<S, M>::get_goodness;
+    minimax.timer.start(INF);
+    S clone = state.clone();
+    // The first search after construction, so the TT has no entries to cut it short.
+    // Killers are reserved and history is allocated by the constructor.
+    const long before = allocations;
+    minimax.minimax(&clone, depth, -INF, INF);
+    const long allocated = allocations - before;
+    assert(minimax.stats.nodes > 0);
+    assert(minimax.stats.tt_cuts < minimax.stats.nodes / 10);
+    return allocated;
+}
+
+template<class S, class M>
+long count_rollout_allocations(S &state) {
+    MonteCarloTreeSearch<S, M> mcts(INF, MAX_SIMULATIONS, 0);
+    mcts.rollout_moves = 0;
+    // a rollout leaves the state at its end, so each one gets a clone made beforehand
+    vector<S> clones;
+    for (int i = 0; i < 100; ++i) {
+        clones.push_back(state.clone());
+    }
+    const long before = allocations;
+    for (S &clone : clones) {
+        mcts.rollout(&clone, clone.player_to_move);
+    }
+    assert(mcts.rollout_moves > 0);
+    return allocations - before;
+}
+
+void test_move_list() {
+    MoveList<int, 4> moves;
+    assert(moves.empty());
+    moves.push_back(1);
+    moves.push_back(2);
+    moves.push_back(3);
+    assert(moves.size() == 3);
+    assert(moves[1] == 2);
+    moves.resize(1);
+    assert(moves.size() == 1);
+    assert(*moves.begin() == 1);
+    moves.clear();
+    assert(moves.empty());
+}
+
+void test_isola_minimax_allocations() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    const long allocated = count_minimax_allocations<IsolaState, IsolaMove>(state, 3);
+    assert(allocated == 0);
+}
+
+void test_isola_rollout_allocations() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    const long allocated = count_rollout_allocations<IsolaState, IsolaMove>(state);
+    assert(allocated == 0);
+}
+
+int main() {
+    test_move_list();
+    test_isola_minimax_allocations();
+    test_isola_rollout_allocations();
+    cout << "OK" << endl;
+}
@@ -34,6 +34,26 @@ void test_has_empty_space() {
     assert(state.is_terminal());
 }
 
+void test_incremental_hash() {
+    ConnectFourState state = ConnectFourState("________"
+                                              "________"
+                                              "________"
+                                              "________"
+                                              "__12____"
+                                              "__212___"
+                                              "221112__");
+    const auto hash = state.hash();
+    const vector<ConnectFourMove> moves = {2, 3, 3, 7, 2};
+    for (const auto &move : moves) {
+        state.make_move(move);
+        assert(state.zobrist == state.compute_zobrist());
+    }
+    for (int i = moves.size() - 1; i >= 0; --i) {
+        state.undo_move(moves[i]);
+    }
+    assert(state.hash() == hash);
+}
+
 void test_finish() {
     ConnectFourState state = ConnectFourState("___12___"
                                               "___11___"
@@ -62,10 +82,36 @@ void test_block() {
     }
 }
 
+void test_proof_number_search() {
+    ConnectFourState state = ConnectFourState("___12___"
+                                              "___11___"
+                                              "___21___"
+                                              "___21___"
+                                              "__112_1_"
+                                              "_222121_"
+                                              "_2211212");
+    ProofNumberSearch<ConnectFourState, ConnectFourMove> proof_number_search(10, 1, 0);
+    auto move = proof_number_search.get_move(&state);
+    assert(proof_number_search.result == PROVEN_WIN);
+    assert(move == ConnectFourMove(6));
+
+    ConnectFourState lost = ConnectFourState("________"
+                                             "________"
+                                             "___1____"
+                                             "___2____"
+                                             "__12____"
+                                             "__212___"
+                                             "221112__");
+    proof_number_search.get_move(&lost);
+    assert(proof_number_search.result == PROVEN_LOSS);
+}
+
 int main() {
     test_is_winner();
     test_has_empty_space();
+    test_incremental_hash();
     test_finish();
     test_block();
+    test_proof_number_search();
     return 0;
 }
\ No newline at end of file
@@ -66,6 +66,26 @@ void test_make_move_3() {
     assert(state == copy);
 }
 
+void test_incremental_hash() {
+    auto state = GoState("_2___"
+                         "12___"
+                         "2____"
+                         "_____"
+                         "_____");
+    const auto hash = state.hash();
+    GoMove move = {0, 0};
+    state.make_move(move);
+    assert(state.zobrist == state.compute_zobrist());
+    state.undo_move(move);
+    assert(state.hash() == hash);
+}
+
+void test_move_packing() {
+    for (const auto &move : {GoMove(0, 0), GoMove(4, 3), GoMove(-1, 0)}) {
+        assert(GoMove::unpack(move.pack()) == move);
+    }
+}
+
 void test_ko() {
     auto state = GoState("_21__"
                          "2_21_"
@@ -104,6 +124,8 @@ int main() {
     test_make_move();
     test_make_move_2();
     test_make_move_3();
+    test_incremental_hash();
+    test_move_packing();
     test_ko();
     test_suicide();
     test_capture();
@@ -4,11 +4,29 @@
 
 static const int MAX_TEST_SIMULATIONS = 1000;
 
+template<class S, class M>
+shared_ptr<Algorithm<S, M>> get_forward_pruning_minimax() {
+    auto minimax = make_shared<Minimax<S, M>>();
+    minimax->use_null_move = true;
+    minimax->use_lmr = true;
+    return minimax;
+}
+
+template<class S, class M>
+shared_ptr<Algorithm<S, M>> get_mtdf_minimax() {
+    auto minimax = make_shared<Minimax<S, M>>();
+    minimax->use_mtdf = true;
+    return minimax;
+}
+
 template<class S, class M>
 vector<shared_ptr<Algorithm<S, M>>> get_algorithms() {
     return {
         shared_ptr<Algorithm<S, M>>(new MonteCarloTreeSearch<S, M>(1, MAX_TEST_SIMULATIONS)),
         shared_ptr<Algorithm<S, M>>(new Minimax<S, M>()),
+        shared_ptr<Algorithm<S, M>>(new Minimax<S, M>(1, INF, nullptr, nullptr, 0, 2)),
+        get_forward_pruning_minimax<S, M>(),
+        get_mtdf_minimax<S, M>(),
     };
 }
 
@@ -129,6 +147,722 @@ void test_isola_make_and_undo_four_players() {
     assert(state == copy);
 }
 
+void test_isola_incremental_hash() {
+    IsolaState state = IsolaState("___3___"
+                                  "_______"
+                                  "_______"
+                                  "2_____4"
+                                  "_______"
+                                  "_______"
+                                  "___1___", {0, 1, 0, 1});
+    const auto hash = state.hash();
+    vector<IsolaMove> moves;
+    for (int i = 0; i < 8; ++i) {
+        const auto move = state.get_legal_moves(10)[i];
+        state.make_move(move);
+        moves.push_back(move);
+        assert(state.zobrist == state.compute_zobrist());
+    }
+    for (int i = moves.size() - 1; i >= 0; --i) {
+        state.undo_move(moves[i]);
+    }
+    assert(state.hash() == hash);
+    state.swap_players();
+    assert(state.zobrist == state.compute_zobrist());
+}
+
+void test_isola_move_packing() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    static_assert(std::is_same<MoveStorage<IsolaMove>::type, uint32_t>::value, "IsolaMove should pack");
+    assert(sizeof(TTEntry<IsolaMove>) <= 12);
+    assert(TranspositionTable<IsolaMove>::SLOTS >= 3);
+    vector<uint32_t> packed_moves;
+    for (const auto &move : state.get_legal_moves()) {
+        const auto packed = move.pack();
+        assert(IsolaMove::unpack(packed) == move);
+        packed_moves.push_back(packed);
+    }
+    sort(packed_moves.begin(), packed_moves.end());
+    assert(unique(packed_moves.begin(), packed_moves.end()) == packed_moves.end());
+}
+
+void test_isola_quiescence() {
+    // 1 has one square to step on, then 2 removes the square it came from
+    IsolaState state = IsolaState("1_#____"
+                                  "###____"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_____2_"
+                                  "_______");
+    MoveList<IsolaMove> noisy_moves;
+    assert(!state.get_noisy_moves(noisy_moves));
+    assert(!noisy_moves.empty());
+
+    Minimax<IsolaState, IsolaMove> minimax;
+    minimax.get_goodness = &State<IsolaState, IsolaMove>::get_goodness;
+    minimax.timer.start(INF);
+    assert(minimax.minimax(&state, 1, -INF, INF).goodness == -10000);
+    assert(minimax.stats.qnodes > 0);
+
+    minimax.quiescence_depth = 0;
+    minimax.clear();
+    assert(minimax.minimax(&state, 1, -INF, INF).goodness > -10000);
+}
+
+void test_isola_forward_pruning() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    assert(state.can_pass());
+    const auto hash = state.hash();
+    state.make_pass();
+    assert(state.player_to_move == 1);
+    assert(state.hash() != hash);
+    state.undo_pass();
+    assert(state.hash() == hash);
+
+    Minimax<IsolaState, IsolaMove> minimax;
+    minimax.get_goodness = &State<IsolaState, IsolaMove>::get_goodness;
+    minimax.use_null_move = true;
+    minimax.use_lmr = true;
+    minimax.timer.start(INF);
+    for (int depth = 1; depth <= 5; ++depth) {
+        minimax.minimax(&state, depth, -INF, INF);
+    }
+    assert(minimax.stats.lmr_reductions > 0);
+    assert(minimax.stats.lmr_researches <= minimax.stats.lmr_reductions);
+    // Even after passing, 1 is far from lost
+    minimax.clear();
+    minimax.minimax(&state, 4, -10000, -9999);
+    assert(minimax.stats.null_tries > 0);
+    assert(minimax.stats.null_cuts > 0);
+    assert(state.hash() == hash);
+}
+
+void test_isola_principal_variation() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    Minimax<IsolaState, IsolaMove> minimax(0.2);
+    const auto move = minimax.get_move(&state);
+    assert(minimax.pv.size() > 1);
+    assert(minimax.pv[0] == move);
+    auto clone = state.clone();
+    for (const auto &pv_move : minimax.pv) {
+        const auto legal_moves = clone.get_legal_moves();
+        assert(find(legal_moves.begin(), legal_moves.end(), pv_move) != legal_moves.end());
+        clone.make_move(pv_move);
+    }
+    assert(minimax.iterations.back().pv_length == minimax.pv.size());
+    assert(minimax.read_log().find("pv_length: " + to_string(minimax.pv.size())) != string::npos);
+
+    const auto tt_size = minimax.transposition_table->size();
+    minimax.reset();
+    assert(minimax.transposition_table->size() == tt_size);
+    minimax.clear();
+    assert(minimax.transposition_table->size() == 0);
+    assert(minimax.pv.empty());
+}
+
+void test_isola_ponder() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    Minimax<IsolaState, IsolaMove> minimax(0.1);
+    MonteCarloTreeSearch<IsolaState, IsolaMove> mcts(0.1, MAX_TEST_SIMULATIONS);
+    vector<Algorithm<IsolaState, IsolaMove>*> algorithms = {&minimax, &mcts};
+    for (auto algorithm : algorithms) {
+        auto clone = state.clone();
+        clone.make_move(algorithm->get_move(&clone));
+        algorithm->read_log();
+        // Minimax ponders its predicted reply, MCTS expands all of them
+        const auto reply = algorithm == &minimax ? minimax.pv[1] : clone.get_legal_moves()[0];
+        algorithm->start_ponder(&clone);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        clone.make_move(reply);
+        algorithm->get_move(&clone);
+        assert(algorithm->read_log().find("ponder: hit") != string::npos);
+
+        // any other position is a miss, the work is discarded
+        clone.make_move(algorithm->get_move(&clone));
+        algorithm->start_ponder(&clone);
+        algorithm->get_move(&state);
+        const auto log = algorithm->read_log();
+        assert(log.find("ponder: miss") != string::npos);
+        assert(log.find("ponder: hit") == string::npos);
+    }
+}
+
+void test_isola_mcts_tree() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    MonteCarloTreeSearch<IsolaState, IsolaMove> mcts(INF, 1000, 0);
+    const auto move = mcts.get_move(&state);
+    // a node per simulation, nothing is terminal this close to the root
+    const auto &tree = *mcts.tree;
+    assert(tree.size() == 1000 - VIRTUAL_VISITS + 1);
+    const auto &root = tree[tree.root];
+    assert(root.children == root.move_count);
+    assert(root.children == state.get_legal_moves().size());
+    unsigned visits = VIRTUAL_VISITS;
+    for (uint32_t child = root.first_child; child != NO_NODE; child = tree[child].next_sibling) {
+        assert(tree[child].parent == tree.root);
+        assert(tree.get_child(tree.root, tree[child].get_move()) == child);
+        visits += tree[child].visits - VIRTUAL_VISITS;
+    }
+    assert(visits == root.visits);
+    assert(tree[tree.get_child(tree.root, move)].visits > VIRTUAL_VISITS + 1);
+
+    // the next tree reuses the memory
+    const auto capacity = tree.capacity();
+    mcts.set_root(&state);
+    assert(tree.size() == 1);
+    assert(tree.capacity() == capacity);
+}
+
+void test_isola_mcts_threads() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    const int threads = 4;
+    MonteCarloTreeSearch<IsolaState, IsolaMove> mcts(INF, 2000, 0, threads);
+    const auto move = mcts.get_move(&state);
+    const auto legal_moves = state.get_legal_moves();
+    assert(find(legal_moves.begin(), legal_moves.end(), move) != legal_moves.end());
+    assert(mcts.read_log().find("threads: 4 simulations per thread: ") != string::npos);
+    const auto &tree = *mcts.tree;
+    const auto &root = tree[tree.root];
+    // every thread stops after the visit that reaches the limit
+    assert(root.visits >= 2000 && root.visits < 2000 + threads);
+    // no virtual loss is left: the results of the children add up to the root's
+    unsigned visits = VIRTUAL_VISITS;
+    double score = 0;
+    for (uint32_t child = root.first_child; child != NO_NODE; child = tree[child].next_sibling) {
+        visits += tree[child].visits - VIRTUAL_VISITS;
+        score += tree[child].visits - VIRTUAL_VISITS - tree[child].score;
+    }
+    assert(visits == root.visits);
+    assert(std::abs(score - root.score) < 1e-6);
+}
+
+void test_isola_mcts_processes() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    MonteCarloTreeSearch<IsolaState, IsolaMove> mcts(INF, 1000, 0);
+    mcts.processes = 3;
+    const auto move = mcts.get_move(&state);
+    const auto legal_moves = state.get_legal_moves();
+    assert(find(legal_moves.begin(), legal_moves.end(), move) != legal_moves.end());
+    const auto log = mcts.read_log();
+    // each process stops at its own max_simulations
+    assert(log.find("process 1 simulations: 995\n") != string::npos);
+    assert(log.find("process 2 simulations: 995\n") != string::npos);
+    assert(log.find("processes: 3 simulations: 2990 wait: ") != string::npos);
+
+    // forking while the ponder thread runs, with threads in each process
+    MonteCarloTreeSearch<IsolaState, IsolaMove> threaded(INF, 1000, 0, 2);
+    threaded.processes = 2;
+    threaded.start_ponder(&state);
+    threaded.get_move(&state);
+    const auto threaded_log = threaded.read_log();
+    assert(threaded_log.find("process 1 simulations: ") != string::npos);
+    assert(threaded_log.find("processes: 2 simulations: ") != string::npos);
+}
+
+void test_isola_mcts_tree_reuse() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    MonteCarloTreeSearch<IsolaState, IsolaMove> mcts(INF, 3000, 0);
+    const auto move = mcts.get_move(&state);
+    assert(mcts.read_log().find("inherited visits: 0") != string::npos);
+    // the most visited reply
+    auto &tree = *mcts.tree;
+    const uint32_t child = tree.get_child(tree.root, move);
+    uint32_t grandchild = tree[child].first_child;
+    for (uint32_t node = grandchild; node != NO_NODE; node = tree[node].next_sibling) {
+        if (tree[node].visits > tree[grandchild].visits) {
+            grandchild = node;
+        }
+    }
+    const unsigned inherited = tree[grandchild].visits - VIRTUAL_VISITS;
+    assert(inherited > 0);
+    const size_t size = tree.size();
+
+    auto clone = state.clone();
+    clone.make_move(move);
+    clone.make_move(tree[grandchild].get_move());
+    mcts.get_move(&clone);
+    const auto log = mcts.read_log();
+    assert(log.find("inherited visits: " + to_string(inherited) + "\n") != string::npos);
+    assert(tree.root == grandchild);
+    assert(tree[tree.root].parent == NO_NODE);
+    // the new simulations took the freed nodes, the arena didn't grow
+    assert(tree.size() + tree.free_count == tree.used);
+    assert(tree.used == size);
+
+    // a position the tree doesn't have starts over
+    mcts.get_move(&state);
+    assert(mcts.read_log().find("inherited visits: 0") != string::npos);
+    assert(tree.size() == 3000 - VIRTUAL_VISITS + 1);
+}
+
+// Tester resets the algorithms before every move, the tree has to survive it
+void test_isola_mcts_tester_reuse() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    const auto mcts = make_shared<MonteCarloTreeSearch<IsolaState, IsolaMove>>(INF, 300, 0);
+    vector<shared_ptr<Algorithm<IsolaState, IsolaMove>>> algorithms = {
+        mcts,
+        make_shared<MonteCarloTreeSearch<IsolaState, IsolaMove>>(INF, 300, 0),
+    };
+    Tester<IsolaState, IsolaMove> tester(&state, algorithms, 1);
+    tester.start();
+    const string log = mcts->read_log();
+    const string prefix = "inherited visits: ";
+    unsigned max_inherited = 0;
+    for (size_t i = log.find(prefix); i != string::npos; i = log.find(prefix, i + 1)) {
+        max_inherited = std::max(max_inherited, (unsigned) stoul(log.substr(i + prefix.size())));
+    }
+    assert(max_inherited > 0);
+}
+
+void test_isola_search_stats() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    Minimax<IsolaState, IsolaMove> minimax(0.1);
+    const auto move = minimax.get_move(&state);
+    const auto &iterations = minimax.iterations;
+    assert(!iterations.empty());
+    assert(minimax.iteration_moves.back() == move);
+    long long nodes = 0;
+    for (int i = 0; i < iterations.size(); ++i) {
+        assert(iterations[i].depth == i + 1);
+        assert(iterations[i].nodes > 0);
+        assert(iterations[i].tt_fill > 0);
+        nodes += iterations[i].nodes;
+    }
+    const auto &total = minimax.total_stats;
+    assert(total.depth == iterations.back().depth);
+    assert(total.nodes >= nodes);
+    assert(total.seconds > 0 && total.get_nps() > 0);
+
+    SearchStats games;
+    games += total;
+    games += total;
+    assert(games.nodes == 2 * total.nodes);
+
+    const auto log = minimax.read_log();
+    assert(log.find("moves: " + to_string(state.get_legal_moves().size()) + "\n") == 0);
+    assert(log.find("max_depth: " + to_string(iterations.back().depth)) != string::npos);
+    assert(minimax.read_log().empty());
+}
+
+// Deterministic, from the point of view of the team to move
+int get_team_mobility(const IsolaState *state) {
+    if (state->is_terminal()) {
+        return -1000;
+    }
+    int result = 0;
+    for (int i = 0; i < state->teams.size(); ++i) {
+        const int moves = state->count_moves_around(state->get_player_cords(i));
+        result += state->is_team_mate(i) ? moves : -moves;
+    }
+    return result;
+}
+
+// Plain paranoid search, without any pruning
+int get_paranoid_goodness(IsolaState &state, int depth) {
+    if (depth == 0 || state.is_terminal()) {
+        return get_team_mobility(&state);
+    }
+    int result = -INF;
+    for (const auto &move : state.get_legal_moves()) {
+        const int mover = state.player_to_move;
+        state.make_move(move);
+        const int goodness = get_paranoid_goodness(state, depth - 1);
+        result = std::max(result, state.is_team_mate(mover) ? goodness : -goodness);
+        state.undo_move(move);
+    }
+    return result;
+}
+
+void test_isola_teams() {
+    // 1 and 2 move back to back, then 3 and 4
+    IsolaState state = IsolaState("#######"
+                                  "#1__3##"
+                                  "#__#__#"
+                                  "#2__4_#"
+                                  "#######"
+                                  "#######"
+                                  "#######", {0, 0, 1, 1});
+    assert(state.get_next_enemy(0) == 2);
+    assert(state.get_next_enemy(1) == 2);
+    assert(state.get_next_enemy(3) == 0);
+    Minimax<IsolaState, IsolaMove> minimax;
+    minimax.get_goodness = get_team_mobility;
+    minimax.quiescence_depth = 0;
+    minimax.timer.start(INF);
+    for (int depth = 1; depth <= 4; ++depth) {
+        minimax.clear();
+        assert(minimax.minimax(&state, depth, -INF, INF).goodness == get_paranoid_goodness(state, depth));
+    }
+
+    // as if the sides alternated, 1 takes the reply of 2 for an enemy's one
+    minimax.clear();
+    minimax.use_teams = false;
+    assert(minimax.minimax(&state, 3, -INF, INF).goodness != get_paranoid_goodness(state, 3));
+}
+
+void test_isola_noise() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    state.noise = false;
+    const auto clone = state.clone();
+    assert(!clone.noise);
+    const int goodness = clone.get_goodness();
+    for (int i = 0; i < 10; ++i) {
+        assert(clone.get_goodness() == goodness);
+    }
+}
+
+void test_isola_mtdf() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "__#____"
+                                  "_______"
+                                  "____#__"
+                                  "_______"
+                                  "___1___");
+    Minimax<IsolaState, IsolaMove> negascout, mtdf;
+    for (auto minimax : {&negascout, &mtdf}) {
+        minimax->get_goodness = get_team_mobility;
+        minimax->quiescence_depth = 0;
+        minimax->timer.start(INF);
+    }
+    mtdf.use_mtdf = true;
+    for (int depth = 1; depth <= 3; ++depth) {
+        const int goodness = negascout.minimax(&state, depth, -INF, INF).goodness;
+        // converges from a bad guess as well
+        assert(mtdf.mtdf_search(&state, depth, 0).goodness == goodness);
+        assert(mtdf.mtdf_search(&state, depth, goodness + 100).goodness == goodness);
+    }
+    assert(mtdf.stats.passes > 6);
+
+    Minimax<IsolaState, IsolaMove> minimax(0.1);
+    minimax.use_mtdf = true;
+    minimax.get_move(&state);
+    for (const auto &iteration : minimax.iterations) {
+        assert(iteration.passes >= 1);
+    }
+    assert(minimax.read_log().find("passes: ") != string::npos);
+}
+
+void test_isola_proof_number_search() {
+    IsolaState state = IsolaState("2#_####"
+                                  "_#_####"
+                                  "__1####"
+                                  "#######"
+                                  "#######"
+                                  "#######"
+                                  "#######");
+    ProofNumberSearch<IsolaState, IsolaMove> proof_number_search(10, 1, 0);
+    auto move = proof_number_search.get_move(&state);
+    assert(proof_number_search.result == PROVEN_WIN);
+    assert(move.remove_x == 0 && move.remove_y == 1);
+
+    IsolaState endgame = IsolaState("__#####"
+                                    "_1_####"
+                                    "__#####"
+                                    "###_2__"
+                                    "####___"
+                                    "#######"
+                                    "#######");
+    move = proof_number_search.get_move(&endgame);
+    assert(proof_number_search.result == PROVEN_WIN);
+    assert(proof_number_search.proving_move == move);
+    assert(proof_number_search.proof_table->size() <= proof_number_search.proof_table->capacity());
+
+    // the proof holds after the winning move, now from the loser's side
+    endgame.make_move(move);
+    proof_number_search.get_move(&endgame);
+    assert(proof_number_search.result == PROVEN_LOSS);
+}
+
+void test_isola_opening_book() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    auto minimax = make_shared<Minimax<IsolaState, IsolaMove>>(0.01);
+    BookBuilder<IsolaState, IsolaMove> builder(minimax, 2, 2);
+    builder.build(state);
+    // the root, then the best move and the first two, which can include it
+    const auto moves = state.get_legal_moves();
+    const bool best_is_first = builder.entries[0].get_move() == moves[0] || builder.entries[0].get_move() == moves[1];
+    assert(builder.entries.size() == (best_is_first ? 3 : 4));
+    const string path = "tests/test_isola.book";
+    builder.save(path);
+
+    auto book = make_shared<OpeningBook<IsolaMove>>(path);
+    assert(book->size() == builder.entries.size());
+    BookAlgorithm<IsolaState, IsolaMove> book_algorithm(book, minimax);
+    const auto move = book_algorithm.get_move(&state);
+    assert(move == builder.entries[0].get_move());
+    assert(book_algorithm.get_score() == builder.entries[0].score);
+    assert(book_algorithm.hits == 1);
+
+    // out of the book after two plies
+    state.make_move(move);
+    state.make_move(book_algorithm.get_move(&state));
+    assert(book_algorithm.hits == 2);
+    book_algorithm.get_move(&state);
+    assert(book_algorithm.misses == 1);
+    remove(path.c_str());
+
+    bool exception_thrown = false;
+    try {
+        OpeningBook<IsolaMove> missing(path);
+    } catch (runtime_error &) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+}
+
+void test_isola_transposition_table_snapshot() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    Minimax<IsolaState, IsolaMove> minimax(0.05, INF, nullptr, nullptr, 0, 1, 1);
+    minimax.get_move(&state);
+    TTEntry<IsolaMove> entry;
+    assert(minimax.transposition_table->get(state.hash(), entry));
+    const string path = "tests/test_isola.tt";
+    minimax.save_transposition_table(path, &state);
+
+    Minimax<IsolaState, IsolaMove> warm(0.05, INF, nullptr, nullptr, 0, 1, 1);
+    assert(warm.load_transposition_table(path, &state) == minimax.transposition_table->size());
+    assert(warm.transposition_table->size() == minimax.transposition_table->size());
+    TTEntry<IsolaMove> loaded;
+    assert(warm.transposition_table->get(state.hash(), loaded));
+    assert(loaded.get_move() == entry.get_move());
+    assert(loaded.value == entry.value && loaded.depth == entry.depth);
+
+    // a damaged record is skipped
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(TTHeader) + sizeof(uint64_t));
+        file.put(0);
+        file.put(0);
+    }
+    Minimax<IsolaState, IsolaMove> smaller(0.05, INF, nullptr, nullptr, 0, 1, 0);
+    assert(smaller.load_transposition_table(path, &state) == minimax.transposition_table->size() - 1);
+
+    const auto assert_rejected = [&path](Minimax<IsolaState, IsolaMove> &algorithm, const IsolaState &state) {
+        bool exception_thrown = false;
+        try {
+            algorithm.load_transposition_table(path, &state);
+        } catch (runtime_error &) {
+            exception_thrown = true;
+        }
+        assert(exception_thrown);
+        assert(algorithm.transposition_table->size() == 0);
+    };
+    Minimax<IsolaState, IsolaMove> larger(0.05, INF, nullptr, nullptr, 0, 1, 2);
+    assert_rejected(larger, state);
+    IsolaState four_players = IsolaState("___2___"
+                                         "_______"
+                                         "4_____3"
+                                         "_______"
+                                         "_______"
+                                         "_______"
+                                         "___1___", {0, 1, 2, 3});
+    Minimax<IsolaState, IsolaMove> other_variant(0.05, INF, nullptr, nullptr, 0, 1, 1);
+    assert_rejected(other_variant, four_players);
+    remove(path.c_str());
+    assert_rejected(other_variant, state);
+}
+
+void test_time_manager() {
+    TimeManager time_manager(20);
+    time_manager.start_move();
+    assert(time_manager.soft_limit == 1);
+    assert(time_manager.hard_limit == 3);
+    assert(time_manager.can_start_iteration(0.5));
+    assert(!time_manager.can_start_iteration(1.1));
+    // 0.5s, then 2.5s predicted: past the hard limit
+    time_manager.add_iteration(0.1, false);
+    time_manager.add_iteration(0.5, false);
+    assert(time_manager.get_ebf() == 5);
+    assert(!time_manager.can_start_iteration(0.6));
+    // 1s predicted, but past the soft limit, unless the best move changed
+    time_manager.add_iteration(0.5, false);
+    assert(!time_manager.can_start_iteration(1.1));
+    time_manager.add_iteration(0.5, true);
+    assert(time_manager.can_start_iteration(1.1));
+    time_manager.end_move(1.5);
+    assert(time_manager.remaining == 18.5);
+
+    // Isola's times alternate, the step two plies back predicts the next one
+    TimeManager parity(20);
+    parity.start_move();
+    for (double seconds : {0.0001, 0.0009, 0.029, 0.26}) {
+        parity.add_iteration(seconds, false);
+    }
+    assert(parity.predict_next_iteration() > parity.hard_limit);
+    assert(!parity.can_start_iteration(0.3));
+
+    // sub-millisecond times don't give ratios, a noisy first iteration doesn't stop the search
+    TimeManager noisy(4);
+    noisy.start_move();
+    noisy.add_iteration(0.0001, false);
+    noisy.add_iteration(0.025, false);
+    assert(noisy.get_ebf() == 12.5);
+    assert(noisy.can_start_iteration(0.026));
+
+    // the hard limit never takes more than max_fraction of what is left
+    TimeManager short_clock(2, 0, 1);
+    short_clock.start_move();
+    assert(short_clock.hard_limit == 0.5);
+    assert(short_clock.soft_limit == 0.5);
+}
+
+void test_isola_time_manager() {
+    IsolaState state = IsolaState("___2___"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "_______"
+                                  "___1___");
+    // the last started iteration completed, none was aborted at the hard limit
+    for (double clock : {4, 20}) {
+        Minimax<IsolaState, IsolaMove> minimax;
+        minimax.time_manager = make_shared<TimeManager>(clock);
+        minimax.get_move(&state);
+        assert(!minimax.iterations.empty());
+        assert(minimax.stats.depth == minimax.iterations.back().depth);
+        assert(minimax.time_manager->remaining == clock - minimax.total_stats.seconds);
+        if (clock == 4) {
+            assert(minimax.read_log().find("soft limit: 0.20s hard limit: 0.60s") != string::npos);
+        }
+    }
+
+    // with one move to choose from there is nothing to search
+    Minimax<IsolaState, IsolaMove> forced(1, 1);
+    forced.time_manager = make_shared<TimeManager>(4);
+    forced.get_move(&state);
+    assert(forced.iterations.empty());
+    assert(forced.time_manager->remaining > 3.99);
+    assert(forced.read_log().find("moves: 1\nforced move: ") == 0);
+}
+
+void test_isola_separated_regions() {
+    IsolaState state = IsolaState("___#___"
+                                  "_1_#_2_"
+                                  "___#___"
+                                  "_#_#__#"
+                                  "#######"
+                                  "#######"
+                                  "#######");
+    int goodness;
+    assert(state.get_solved_goodness(goodness));
+    assert(goodness == 10000);
+    state.player_to_move = 1;
+    assert(state.get_solved_goodness(goodness));
+    assert(goodness == 10000);
+
+    // exact, agrees with the full search
+    IsolaState small = IsolaState("_1#####"
+                                  "__#####"
+                                  "###__##"
+                                  "###_2_#"
+                                  "#######"
+                                  "#######"
+                                  "#######");
+    assert(small.get_solved_goodness(goodness));
+    ProofNumberSearch<IsolaState, IsolaMove> proof_number_search(10, 1, 0);
+    proof_number_search.get_move(&small);
+    assert(proof_number_search.result != UNKNOWN);
+    assert((proof_number_search.result == PROVEN_WIN) == (goodness > 0));
+
+    IsolaState connected = IsolaState("___#___"
+                                      "_1___2_"
+                                      "___#___"
+                                      "_#_#___"
+                                      "#######"
+                                      "#######"
+                                      "#######");
+    assert(!connected.get_solved_goodness(goodness));
+
+    Minimax<IsolaState, IsolaMove> minimax(0.1);
+    const auto move = minimax.get_move(&state);
+    assert(minimax.total_stats.solved > 0);
+    assert(minimax.get_score() == 10000);
+    state.make_move(move);
+    assert(state.get_solved_goodness(goodness));
+    assert(goodness == -10000);
+}
+
 void test_isola_terminal_four_players() {
     IsolaState state = IsolaState("_______"
                                   "_#_####"
@@ -178,6 +912,27 @@ int main() {
     test_isola_terminal();
     test_isola_make_and_undo();
     test_isola_make_and_undo_four_players();
+    test_isola_incremental_hash();
+    test_isola_move_packing();
+    test_isola_quiescence();
+    test_isola_forward_pruning();
+    test_isola_principal_variation();
+    test_isola_ponder();
+    test_isola_mcts_tree();
+    test_isola_mcts_tree_reuse();
+    test_isola_mcts_tester_reuse();
+    test_isola_mcts_threads();
+    test_isola_mcts_processes();
+    test_isola_search_stats();
+    test_isola_teams();
+    test_isola_noise();
+    test_isola_mtdf();
+    test_isola_proof_number_search();
+    test_isola_opening_book();
+    test_isola_transposition_table_snapshot();
+    test_time_manager();
+    test_isola_time_manager();
+    test_isola_separated_regions();
     test_isola_terminal_four_players();
     test_get_remove_moves();
     return 0;
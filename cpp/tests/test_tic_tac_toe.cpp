@@ -98,6 +98,22 @@ void test_tic_tac_toe_terminal() {
     }
 }
 
+void test_tic_tac_toe_incremental_hash() {
+    TicTacToeState state = TicTacToeState("X__"
+                                          "_O_"
+                                          "___");
+    const auto hash = state.hash();
+    const vector<TicTacToeMove> moves = {{2, 0}, {1, 0}, {0, 2}};
+    for (const auto &move : moves) {
+        state.make_move(move);
+        assert(state.zobrist == state.compute_zobrist());
+    }
+    for (int i = moves.size() - 1; i >= 0; --i) {
+        state.undo_move(moves[i]);
+    }
+    assert(state.hash() == hash);
+}
+
 void test_tic_tac_toe_draw() {
     TicTacToeState state = TicTacToeState("___"
                                           "___"
@@ -118,6 +134,7 @@ int main() {
     test_tic_tac_toe_block_5();
     test_tic_tac_toe_corner();
     test_tic_tac_toe_terminal();
+    test_tic_tac_toe_incremental_hash();
     test_tic_tac_toe_draw();
     return 0;
 }
\ No newline at end of file